@@ -5,12 +5,21 @@ layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+// shared by all programs, see uniform_buffers.h
+layout (std140) uniform CameraBlock {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+} camera;
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// packed meshes store positions normalized to their bounding box (see Mesh)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 void main()
 {
+    vec3 position = positionOffset + aPos * positionScale;
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = camera.projection * camera.view * model * vec4(position, 1.0);
 }
\ No newline at end of file
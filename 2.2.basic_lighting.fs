@@ -1,14 +1,15 @@
 #version 330 core
 out vec4 FragColor;
 
-struct Material {
-    sampler2D diffuse;
-    sampler2D specular;    
-    float shininess;
-}; 
+// shared by all programs, see uniform_buffers.h
+layout (std140) uniform CameraBlock {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+} camera;
 
-struct Light {
-    vec3 position;  
+layout (std140) uniform LightBlock {
+    vec3 position;
   
     vec3 ambient;
     vec3 diffuse;
@@ -17,15 +18,22 @@ struct Light {
     float constant;
     float linear;
     float quadratic;
+} light;
+
+layout (std140) uniform MaterialBlock {
+    float shininess;
+} materialParams;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;    
 };
 
 in vec3 FragPos;  
 in vec3 Normal;  
 in vec2 TexCoords;
   
-uniform vec3 viewPos;
 uniform Material material;
-uniform Light light;
 
 void main()
 {
@@ -39,9 +47,9 @@ void main()
     vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;  
     
     // specular
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(camera.viewPos.xyz - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);  
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), materialParams.shininess);
     vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;  
     
     // attenuation
@@ -7,15 +7,25 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
+// shared by all programs, see uniform_buffers.h
+layout (std140) uniform CameraBlock {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+} camera;
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix; // transpose(inverse(mat3(model))), computed once per object on the CPU
+// packed meshes store positions normalized to their bounding box (see Mesh)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    vec3 position = positionOffset + aPos * positionScale;
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;
     
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    gl_Position = camera.projection * camera.view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+// shared by all programs, see uniform_buffers.h
+layout (std140) uniform CameraBlock {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+} camera;
+
+// 2.2.basic_lighting.vs as it was before the normal matrix moved to the CPU, kept for --bench-normal-matrix
+uniform mat4 model;
+// packed meshes store positions normalized to their bounding box (see Mesh)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+void main()
+{
+    vec3 position = positionOffset + aPos * positionScale;
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    TexCoords = aTexCoords;
+    
+    gl_Position = camera.projection * camera.view * vec4(FragPos, 1.0);
+}
\ No newline at end of file
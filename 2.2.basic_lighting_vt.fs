@@ -0,0 +1,99 @@
+#version 330 core
+out vec4 FragColor;
+
+// shared by all programs, see uniform_buffers.h
+layout (std140) uniform CameraBlock {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+} camera;
+
+layout (std140) uniform LightBlock {
+    vec3 position;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+	
+    float constant;
+    float linear;
+    float quadratic;
+} light;
+
+layout (std140) uniform MaterialBlock {
+    float shininess;
+} materialParams;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;    
+};
+
+// virtual texture, see virtual_texture.h
+struct VirtualTexture {
+    sampler2D atlas;
+    sampler2D indirection;
+    vec2 scale;         // image size / virtual texture size
+    float virtualSize;  // texels along one side of level 0
+    float maxLevel;
+    float pageSize;
+    float border;
+    float atlasSize;
+    float lodBias;
+};
+
+uniform VirtualTexture vt;
+
+float vtLevel(vec2 uv)
+{
+    vec2 dx = dFdx(uv * vt.virtualSize);
+    vec2 dy = dFdy(uv * vt.virtualSize);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vt.lodBias;
+    return clamp(floor(lod), 0.0, vt.maxLevel);
+}
+
+vec4 vtSample(vec2 texCoords)
+{
+    float level = vtLevel(texCoords * vt.scale);
+    vec2 uv = fract(texCoords) * vt.scale;
+    vec4 entry = floor(texelFetch(vt.indirection, ivec2(uv * exp2(vt.maxLevel - level)), int(level)) * 255.0 + 0.5);
+    // the entry points at a coarser page (entry.b) while the requested one is still loading
+    vec2 inPage = fract(uv * exp2(vt.maxLevel - entry.b));
+    vec2 texel = entry.rg * (vt.pageSize + 2.0 * vt.border) + vt.border + inPage * vt.pageSize;
+    return textureLod(vt.atlas, texel / vt.atlasSize, 0.0);
+}
+
+in vec3 FragPos;  
+in vec3 Normal;  
+in vec2 TexCoords;
+  
+uniform Material material;
+
+void main()
+{
+    // ambient
+    vec3 ambient = light.ambient * vtSample(TexCoords).rgb;
+  	
+    // diffuse 
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(light.position - FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * vtSample(TexCoords).rgb;  
+    
+    // specular
+    vec3 viewDir = normalize(camera.viewPos.xyz - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);  
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), materialParams.shininess);
+    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;  
+    
+    // attenuation
+    float distance    = length(light.position - FragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+
+    ambient  *= attenuation;  
+    diffuse   *= attenuation;
+    specular *= attenuation;   
+        
+    vec3 result = ambient + diffuse + specular;
+    FragColor = vec4(result, 1.0);
+} 
\ No newline at end of file
@@ -3,11 +3,20 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+// shared by all programs, see uniform_buffers.h
+layout (std140) uniform CameraBlock {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+} camera;
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// packed meshes store positions normalized to their bounding box (see Mesh)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	vec3 position = positionOffset + aPos * positionScale;
+	gl_Position = camera.projection * camera.view * model * vec4(position, 1.0);
 }
\ No newline at end of file
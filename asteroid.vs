@@ -0,0 +1,41 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance (see MeshInstance): position and uniform scale, rotation quaternion
+layout (location = 5) in vec4 aInstancePositionScale;
+layout (location = 6) in vec4 aInstanceRotation;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+// shared by all programs, see uniform_buffers.h
+layout (std140) uniform CameraBlock {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+} camera;
+
+uniform mat4 model; // places the whole belt
+uniform mat3 normalMatrix; // transpose(inverse(mat3(model)))
+// packed meshes store positions normalized to their bounding box (see Mesh)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    vec3 position = positionOffset + aPos * positionScale;
+    vec3 local = aInstancePositionScale.xyz + rotate(aInstanceRotation, position * aInstancePositionScale.w);
+    FragPos = vec3(model * vec4(local, 1.0));
+    // instances only rotate and scale uniformly, which leaves normals as they are
+    Normal = normalMatrix * rotate(aInstanceRotation, aNormal);
+    TexCoords = aTexCoords;
+
+    gl_Position = camera.projection * camera.view * vec4(FragPos, 1.0);
+}
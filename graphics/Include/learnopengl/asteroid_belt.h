@@ -0,0 +1,235 @@
+#ifndef ASTEROID_BELT_H
+#define ASTEROID_BELT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/frustum_culler.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+using namespace std;
+
+// A ring of randomly placed, rotated and scaled rocks for Model::DrawInstanced. The instances sit in the xz plane
+// around the origin (place the ring with the model matrix), evenly spread over the ring's area and thinning out
+// above and below it. Any prefix of the instances is as evenly spread as the whole set, so drawing fewer of them
+// thins the belt out uniformly.
+//
+// For occlusion culling the ring is split into CLUSTERS sectors around its axis; cull() finds the visible
+// instances grouped by sector and uploadVisible() uploads them, so each sector can be drawn (or skipped) on its own.
+class AsteroidBelt
+{
+public:
+    static const unsigned int CLUSTERS = 16;
+    static const unsigned int CULL_GRAIN = 16384;   // instances per chunk of cull()
+
+    vector<MeshInstance> instances;
+
+    AsteroidBelt() : buffer(0), visibleCount(0)
+    {
+    }
+
+    void generate(unsigned int count, float innerRadius, float outerRadius, float thickness, float minScale, float maxScale,
+                  unsigned int seed = 1)
+    {
+        mt19937 random(seed);
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+        normal_distribution<float> height(0.0f, thickness * 0.5f);
+        instances.resize(count);
+        for(unsigned int i = 0; i < count; i++)
+        {
+            // uniform over the ring's area
+            float radius = sqrt(innerRadius * innerRadius + unit(random) * (outerRadius * outerRadius - innerRadius * innerRadius));
+            float angle = unit(random) * 6.28318530718f;
+            float scale = minScale + unit(random) * (maxScale - minScale);
+            instances[i].positionScale = glm::vec4(cos(angle) * radius, height(random), sin(angle) * radius, scale);
+
+            // uniformly distributed rotation (Shoemake)
+            float u1 = unit(random), u2 = unit(random) * 6.28318530718f, u3 = unit(random) * 6.28318530718f;
+            float a = sqrt(1.0f - u1), b = sqrt(u1);
+            instances[i].rotation = glm::vec4(a * sin(u2), a * cos(u2), b * sin(u3), b * cos(u3));
+        }
+
+        updateClusters();
+    }
+
+    // moves the instances 'alpha' of the way from 'previousX..' to 'x..' (structure-of-arrays, one per instance),
+    // e.g. between the last two steps of a simulation; the next cull() and uploadVisible() pick them up
+    void setPositions(const float *previousX, const float *previousY, const float *previousZ,
+                      const float *x, const float *y, const float *z, float alpha)
+    {
+        for(unsigned int i = 0; i < instances.size(); i++)
+        {
+            instances[i].positionScale.x = previousX[i] + (x[i] - previousX[i]) * alpha;
+            instances[i].positionScale.y = previousY[i] + (y[i] - previousY[i]) * alpha;
+            instances[i].positionScale.z = previousZ[i] + (z[i] - previousZ[i]) * alpha;
+        }
+        updateClusters();
+    }
+
+    // copies the instances to a vertex buffer (GL thread only); pass instanceBuffer() to Model::setInstanceBuffer
+    void upload()
+    {
+        if(!buffer)
+            glGenBuffers(1, &buffer);
+        GLState::get().bindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(MeshInstance), instances.data(), GL_STATIC_DRAW);
+    }
+
+    // finds the instances inside the culler's frustum, placed by 'model', and returns how many that is; they are
+    // grouped by sector, see clusterFirst()/clusterCount(), and uploadVisible() puts them in the instance buffer.
+    // 'meshBounds' is the bounding sphere of the rock model. CPU only, split into chunks over 'jobs': each chunk
+    // culls and counts its sectors, and after a prefix sum over the counts each scatters its rocks into place.
+    unsigned int cull(FrustumCuller &culler, const glm::mat4 &model, const glm::vec4 &meshBounds, JobSystem &jobs)
+    {
+        unsigned int total = (unsigned int)instances.size();
+        unsigned int chunks = (total + CULL_GRAIN - 1) / CULL_GRAIN;
+        if(visible.size() != total)
+        {
+            visible.resize(total);
+            grouped.resize(total);
+            chunkCount.resize(chunks);
+            chunkNext.resize(chunks * CLUSTERS);
+        }
+        jobs.parallelFor(chunks, 1, [&](unsigned int first, unsigned int last)
+        {
+            for(unsigned int k = first; k < last; k++)
+            {
+                unsigned int begin = k * CULL_GRAIN, size = min(total - begin, (unsigned int)CULL_GRAIN);
+                unsigned int count = culler.cullInstances(&instances[begin], size, meshBounds, model, &visible[begin]);
+                chunkCount[k] = count;
+                unsigned int *histogram = &chunkNext[k * CLUSTERS];
+                for(unsigned int c = 0; c < CLUSTERS; c++)
+                    histogram[c] = 0;
+                for(unsigned int i = begin; i < begin + count; i++)
+                    histogram[cluster(visible[i].positionScale)]++;
+            }
+        });
+
+        // counting sort by sector: sector by sector, chunk by chunk, so each chunk knows where its rocks go
+        unsigned int offset = 0;
+        for(unsigned int c = 0; c < CLUSTERS; c++)
+        {
+            firstOfCluster[c] = offset;
+            for(unsigned int k = 0; k < chunks; k++)
+            {
+                unsigned int n = chunkNext[k * CLUSTERS + c];
+                chunkNext[k * CLUSTERS + c] = offset;
+                offset += n;
+            }
+            countOfCluster[c] = offset - firstOfCluster[c];
+        }
+        jobs.parallelFor(chunks, 1, [&](unsigned int first, unsigned int last)
+        {
+            for(unsigned int k = first; k < last; k++)
+            {
+                unsigned int *next = &chunkNext[k * CLUSTERS];
+                for(unsigned int i = k * CULL_GRAIN; i < k * CULL_GRAIN + chunkCount[k]; i++)
+                    grouped[next[cluster(visible[i].positionScale)]++] = visible[i];
+            }
+        });
+        visibleCount = offset;
+        return visibleCount;
+    }
+
+    // uploads the instances the last cull() found visible in place of all of them (GL thread only). Called every
+    // frame, the buffer is respecified at the visible size, so the driver orphans the previous frame's storage
+    // instead of waiting on its draw, and only the visible rocks are allocated and copied.
+    void uploadVisible()
+    {
+        if(!buffer)
+            glGenBuffers(1, &buffer);
+        GLState::get().bindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, visibleCount * sizeof(MeshInstance), grouped.data(), GL_STREAM_DRAW);
+    }
+
+    // the visible instances of sector 'c' after cull(), as a range of the instance buffer
+    unsigned int clusterFirst(unsigned int c) const { return firstOfCluster[c]; }
+    unsigned int clusterCount(unsigned int c) const { return countOfCluster[c]; }
+
+    // box in the belt's space around every instance of sector 'c', for a rock with bounding sphere 'meshBounds'
+    void clusterBox(unsigned int c, const glm::vec4 &meshBounds, glm::vec3 &boxMin, glm::vec3 &boxMax) const
+    {
+        float radius = clusterScale[c] * (glm::length(glm::vec3(meshBounds)) + meshBounds.w);
+        boxMin = clusterLow[c] - glm::vec3(radius);
+        boxMax = clusterHigh[c] + glm::vec3(radius);
+    }
+
+    unsigned int instanceBuffer() const { return buffer; }
+    unsigned int size() const { return (unsigned int)instances.size(); }
+
+    // model matrix of one instance, for drawing it on its own
+    glm::mat4 instanceMatrix(unsigned int i) const
+    {
+        const MeshInstance &instance = instances[i];
+        glm::vec3 q = glm::vec3(instance.rotation);
+        float w = instance.rotation.w;
+        glm::mat3 rotation(1.0f - 2.0f * (q.y * q.y + q.z * q.z), 2.0f * (q.x * q.y + w * q.z), 2.0f * (q.x * q.z - w * q.y),
+                           2.0f * (q.x * q.y - w * q.z), 1.0f - 2.0f * (q.x * q.x + q.z * q.z), 2.0f * (q.y * q.z + w * q.x),
+                           2.0f * (q.x * q.z + w * q.y), 2.0f * (q.y * q.z - w * q.x), 1.0f - 2.0f * (q.x * q.x + q.y * q.y));
+        glm::mat4 matrix(rotation * instance.positionScale.w);
+        matrix[3] = glm::vec4(glm::vec3(instance.positionScale), 1.0f);
+        return matrix;
+    }
+
+    // deletes the buffer; call while the GL context is still current
+    void release()
+    {
+        if(buffer)
+            GLState::get().deleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+private:
+    unsigned int buffer;
+    vector<MeshInstance> visible, grouped;  // scratch for cull(), kept to avoid allocating per frame
+    vector<unsigned int> chunkCount;        // visible rocks of each chunk of CULL_GRAIN
+    vector<unsigned int> chunkNext;         // per chunk and sector: rocks, then where the next one goes
+    unsigned int visibleCount;
+    // sectors: bounds of the instance positions, largest scale, and the visible range after cull()
+    glm::vec3 clusterLow[CLUSTERS], clusterHigh[CLUSTERS];
+    float clusterScale[CLUSTERS];
+    unsigned int firstOfCluster[CLUSTERS], countOfCluster[CLUSTERS];
+
+    // bounds of each sector
+    void updateClusters()
+    {
+        for(unsigned int c = 0; c < CLUSTERS; c++)
+        {
+            clusterLow[c] = glm::vec3(1e30f);
+            clusterHigh[c] = glm::vec3(-1e30f);
+            clusterScale[c] = 0.0f;
+            firstOfCluster[c] = countOfCluster[c] = 0;
+        }
+        for(unsigned int i = 0; i < instances.size(); i++)
+        {
+            const glm::vec4 &instance = instances[i].positionScale;
+            unsigned int c = cluster(instance);
+            clusterLow[c] = glm::min(clusterLow[c], glm::vec3(instance));
+            clusterHigh[c] = glm::max(clusterHigh[c], glm::vec3(instance));
+            clusterScale[c] = max(clusterScale[c], instance.w);
+        }
+    }
+
+    // sector of an instance, from its position's "diamond angle" around the axis (monotonic in the angle,
+    // without trigonometry)
+    static unsigned int cluster(const glm::vec4 &position)
+    {
+        float x = position.x, z = position.z;
+        float sum = fabs(x) + fabs(z);
+        if(sum == 0.0f)
+            return 0;
+        float diamond = z >= 0.0f ? (x >= 0.0f ? z / sum : 1.0f - x / sum) : (x < 0.0f ? 2.0f - z / sum : 3.0f + x / sum);
+        unsigned int c = (unsigned int)(diamond * (CLUSTERS / 4.0f));
+        return c < CLUSTERS ? c : CLUSTERS - 1;
+    }
+
+    AsteroidBelt(const AsteroidBelt&);
+    AsteroidBelt& operator=(const AsteroidBelt&);
+};
+#endif
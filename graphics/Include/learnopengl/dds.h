@@ -0,0 +1,212 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <glad/glad.h>
+
+extern "C" {
+#include <image_DXT.h>
+}
+#include <learnopengl/dxt_encoder.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// S3TC formats (EXT_texture_compression_s3tc), not part of the core profile glad header
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+const unsigned int DDS_MAGIC = 0x20534444; // "DDS "
+const unsigned int DDS_FOURCC_DXT1 = 0x31545844; // "DXT1"
+const unsigned int DDS_FOURCC_DXT5 = 0x35545844; // "DXT5"
+
+// Block compressed images with a full mip chain, stored as DirectDraw Surface files.
+// Compression uses DXTEncoder: DXT1 for RGB, DXT5 for RGBA images.
+class DDS
+{
+public:
+    // bytes in one block compressed mip level
+    static size_t levelSize(GLenum format, int width, int height)
+    {
+        size_t blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+    }
+
+    // number of levels in a full mip chain down to 1x1
+    static int mipCount(int width, int height)
+    {
+        int count = 1;
+        while(width > 1 || height > 1)
+        {
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+            count++;
+        }
+        return count;
+    }
+
+    // true if 'ddsPath' exists and is at least as new as 'sourcePath'
+    static bool isFresh(string const &ddsPath, string const &sourcePath)
+    {
+        struct stat dds, source;
+        if(stat(ddsPath.c_str(), &dds) != 0 || stat(sourcePath.c_str(), &source) != 0)
+            return false;
+        return dds.st_mtime >= source.st_mtime;
+    }
+
+    // compresses an RGB(A) image and all of its mip levels, appending the levels largest first to 'out'.
+    // returns the GL format of the result, or 0 for images that are not 3 or 4 channel.
+    static GLenum compress(const unsigned char *pixels, int width, int height, int channels, vector<unsigned char> &out, int &levels)
+    {
+        if(channels != 3 && channels != 4)
+            return 0;
+        GLenum format = channels == 3 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        levels = mipCount(width, height);
+
+        vector<unsigned char> mip, blocks;
+        const unsigned char *level = pixels;
+        for(int i = 0; i < levels; i++)
+        {
+            // on the calling thread: textures are compressed on the loader's and the streamer's workers, which
+            // already keep the cores busy
+            DXTEncoder::compress(level, width, height, channels, channels == 4, blocks, 1);
+            out.insert(out.end(), blocks.begin(), blocks.end());
+
+            if(i + 1 < levels)
+            {
+                vector<unsigned char> next;
+                downsample(level, width, height, channels, next);
+                mip.swap(next);
+                level = mip.data();
+                width = width > 1 ? width / 2 : 1;
+                height = height > 1 ? height / 2 : 1;
+            }
+        }
+        return format;
+    }
+
+    // writes compressed levels as a DDS file (through a temporary file, so readers never see a partial one)
+    static bool write(string const &path, GLenum format, int width, int height, int levels, const vector<unsigned char> &data)
+    {
+        DDS_header header;
+        memset(&header, 0, sizeof(header));
+        header.dwMagic = DDS_MAGIC;
+        header.dwSize = 124;
+        header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+        header.dwHeight = height;
+        header.dwWidth = width;
+        header.dwPitchOrLinearSize = (unsigned int)levelSize(format, width, height);
+        header.dwMipMapCount = levels;
+        header.sPixelFormat.dwSize = 32;
+        header.sPixelFormat.dwFlags = DDPF_FOURCC;
+        header.sPixelFormat.dwFourCC = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? DDS_FOURCC_DXT1 : DDS_FOURCC_DXT5;
+        header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+        string tempPath = path + ".tmp";
+        ofstream out(tempPath.c_str(), ios::binary | ios::trunc);
+        if(!out)
+            return false;
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)data.data(), data.size());
+        out.close();
+        if(!out)
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        std::remove(path.c_str());
+        return std::rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+
+    // reads a DXT1/DXT5 DDS file written by write(); returns the GL format, or 0 if the file is missing or unusable
+    static GLenum read(string const &path, int &width, int &height, int &levels, vector<unsigned char> &data)
+    {
+        ifstream in(path.c_str(), ios::binary | ios::ate);
+        if(!in)
+            return 0;
+        size_t fileSize = (size_t)in.tellg();
+        if(fileSize < sizeof(DDS_header))
+            return 0;
+        in.seekg(0);
+        DDS_header header;
+        in.read((char*)&header, sizeof(header));
+        if(!in || header.dwMagic != DDS_MAGIC || !(header.sPixelFormat.dwFlags & DDPF_FOURCC))
+            return 0;
+
+        GLenum format;
+        if(header.sPixelFormat.dwFourCC == DDS_FOURCC_DXT1)
+            format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        else if(header.sPixelFormat.dwFourCC == DDS_FOURCC_DXT5)
+            format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else
+            return 0;
+        width = header.dwWidth;
+        height = header.dwHeight;
+        levels = header.dwMipMapCount ? header.dwMipMapCount : 1;
+        if(width < 1 || height < 1 || levels > mipCount(width, height))
+            return 0;
+
+        size_t expected = 0;
+        for(int i = 0, w = width, h = height; i < levels; i++, w = w > 1 ? w / 2 : 1, h = h > 1 ? h / 2 : 1)
+            expected += levelSize(format, w, h);
+        if(fileSize - sizeof(DDS_header) < expected)
+            return 0;
+        data.resize(expected);
+        in.read((char*)data.data(), expected);
+        return in ? format : 0;
+    }
+
+    // uploads compressed levels (from client memory, or from a bound GL_PIXEL_UNPACK_BUFFER when data is an offset)
+    // into the texture bound to GL_TEXTURE_2D
+    static void upload(GLenum format, int width, int height, int levels, const unsigned char *data)
+    {
+        size_t offset = 0;
+        for(int i = 0; i < levels; i++)
+        {
+            size_t size = levelSize(format, width, height);
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, format, width, height, 0, (GLsizei)size, data + offset);
+            offset += size;
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+
+private:
+    // 2x2 box filter to the next mip level; odd edges reuse their last row/column
+    static void downsample(const unsigned char *src, int width, int height, int channels, vector<unsigned char> &dst)
+    {
+        int w = width > 1 ? width / 2 : 1;
+        int h = height > 1 ? height / 2 : 1;
+        dst.resize((size_t)w * h * channels);
+        for(int y = 0; y < h; y++)
+        {
+            int y0 = y * 2 < height ? y * 2 : height - 1;
+            int y1 = y0 + 1 < height ? y0 + 1 : y0;
+            for(int x = 0; x < w; x++)
+            {
+                int x0 = x * 2 < width ? x * 2 : width - 1;
+                int x1 = x0 + 1 < width ? x0 + 1 : x0;
+                for(int c = 0; c < channels; c++)
+                {
+                    int sum = src[((size_t)y0 * width + x0) * channels + c] + src[((size_t)y0 * width + x1) * channels + c] +
+                              src[((size_t)y1 * width + x0) * channels + c] + src[((size_t)y1 * width + x1) * channels + c];
+                    dst[((size_t)y * w + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,546 @@
+#ifndef DXT_ENCODER_H
+#define DXT_ENCODER_H
+
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Vectorized, multi-threaded DXT1/DXT5 block encoder
+// -------------------------------------------------
+// Replaces the scalar image_DXT encoder for texture compression. Each 4x4 block is held as structure-of-arrays
+// floats (R, G and B of 16 pixels in 4 SSE2 registers each, or 2 AVX2 registers when compiled with /arch:AVX2)
+// and encoded as:
+//   1. principal axis of the block colors (covariance + power iteration), endpoints at the extreme projections
+//   2. index selection by projecting every pixel onto the line through the 565 quantized endpoints
+//   3. one least-squares refinement of the endpoints for those indices, followed by a final index selection
+// Rows of blocks are handed out to 'threadCount' threads (one per core by default) through an atomic counter.
+// Callers that already run on a worker of their own (texture loading does) pass 1 so the cores aren't
+// oversubscribed.
+//
+// Quality: over the bundled textures the RGB RMSE is at or below the image_DXT encoder's, and never more than
+// 0.5 above it (see benchmark(), which reports both along with throughput in megapixels per second).
+class DXTEncoder
+{
+public:
+    // compresses a whole image (1-4 channels, 8 bits each). DXT1 ignores alpha; DXT5 encodes the last channel of
+    // 2 and 4 channel images as alpha. 'out' receives ((w+3)/4)*((h+3)/4) blocks of 8 (DXT1) or 16 (DXT5) bytes.
+    static void compress(const unsigned char *pixels, int width, int height, int channels, bool dxt5,
+                         vector<unsigned char> &out, unsigned int threadCount = 0)
+    {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        size_t blockBytes = dxt5 ? 16 : 8;
+        out.resize((size_t)blocksX * blocksY * blockBytes);
+
+        if(threadCount == 0)
+            threadCount = thread::hardware_concurrency();
+        if(threadCount == 0)
+            threadCount = 1;
+        if(threadCount > (unsigned int)blocksY)
+            threadCount = blocksY;
+
+        atomic<int> nextRow(0);
+        unsigned char *dst = out.data();
+        auto worker = [&]()
+        {
+            for(int by = nextRow++; by < blocksY; by = nextRow++)
+            {
+                unsigned char *row = dst + (size_t)by * blocksX * blockBytes;
+                for(int bx = 0; bx < blocksX; bx++)
+                {
+                    unsigned char rgba[64];
+                    gather(pixels, width, height, channels, bx * 4, by * 4, rgba);
+                    unsigned char *block = row + bx * blockBytes;
+                    if(dxt5)
+                    {
+                        encodeAlphaBlock(rgba, block);
+                        encodeColorBlock(rgba, block + 8);
+                    }
+                    else
+                        encodeColorBlock(rgba, block);
+                }
+            }
+        };
+        if(threadCount == 1)
+        {
+            worker();
+            return;
+        }
+        vector<thread> threads;
+        for(unsigned int i = 1; i < threadCount; i++)
+            threads.push_back(thread(worker));
+        worker();
+        for(unsigned int i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+
+    // decodes one DXT1 color block (or the color half of a DXT5 block) to 16 RGBA pixels
+    static void decodeColorBlock(const unsigned char *block, unsigned char rgba[64])
+    {
+        unsigned int c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+        unsigned int bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+        int palette[4][4];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for(int c = 0; c < 3; c++)
+        {
+            if(c0 > c1)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+        for(int i = 0; i < 16; i++)
+        {
+            int index = (bits >> (2 * i)) & 3;
+            rgba[i * 4 + 0] = (unsigned char)palette[index][0];
+            rgba[i * 4 + 1] = (unsigned char)palette[index][1];
+            rgba[i * 4 + 2] = (unsigned char)palette[index][2];
+            rgba[i * 4 + 3] = 255;
+        }
+    }
+
+    // decodes the alpha half of a DXT5 block into the alpha bytes of 16 RGBA pixels
+    static void decodeAlphaBlock(const unsigned char *block, unsigned char rgba[64])
+    {
+        int a0 = block[0], a1 = block[1];
+        int palette[8] = { a0, a1 };
+        for(int i = 2; i < 8; i++)
+        {
+            if(a0 > a1)
+                palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+            else
+                palette[i] = i < 6 ? ((6 - i) * a0 + (i - 1) * a1) / 5 : (i == 6 ? 0 : 255);
+        }
+        unsigned long long bits = 0;
+        for(int i = 0; i < 6; i++)
+            bits |= (unsigned long long)block[2 + i] << (8 * i);
+        for(int i = 0; i < 16; i++)
+            rgba[i * 4 + 3] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+    }
+
+    // compares this encoder with the scalar image_DXT one (passed in as 'reference' so this header doesn't depend
+    // on it) on an RGB(A) image, printing megapixels per second and RGB RMSE for both. Returns false if the quality
+    // bound stated above is exceeded.
+    typedef unsigned char *(*ReferenceEncoder)(const unsigned char *const, int, int, int, int *);
+    static bool benchmark(const unsigned char *pixels, int width, int height, int channels, ReferenceEncoder reference, ostream &log)
+    {
+        double megapixels = (double)width * height / 1e6;
+        log << "DXT1 encode of " << width << "x" << height << "x" << channels << " (" << megapixels << " MP)" << endl;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        int referenceSize = 0;
+        unsigned char *referenceBlocks = reference(pixels, width, height, channels, &referenceSize);
+        double referenceSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double referenceError = rmse(pixels, width, height, channels, referenceBlocks);
+        free(referenceBlocks);
+        log << "  image_DXT (scalar, 1 thread): " << megapixels / referenceSeconds << " MP/s, RMSE " << referenceError << endl;
+
+        vector<unsigned char> blocks;
+        start = chrono::steady_clock::now();
+        compress(pixels, width, height, channels, false, blocks, 1);
+        double singleSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double error = rmse(pixels, width, height, channels, blocks.data());
+        log << "  DXTEncoder (" << simdName() << ", 1 thread): " << megapixels / singleSeconds << " MP/s, RMSE " << error << endl;
+
+        unsigned int threads = max(thread::hardware_concurrency(), 1u);
+        start = chrono::steady_clock::now();
+        compress(pixels, width, height, channels, false, blocks, threads);
+        double parallelSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        log << "  DXTEncoder (" << simdName() << ", " << threads << " threads): " << megapixels / parallelSeconds
+            << " MP/s, " << referenceSeconds / parallelSeconds << "x faster than image_DXT" << endl;
+
+        bool ok = error <= referenceError + 0.5;
+        log << "  quality " << (ok ? "OK" : "FAILED") << " (bound: RMSE <= image_DXT RMSE + 0.5)" << endl;
+        return ok;
+    }
+
+private:
+    static const char *simdName()
+    {
+#ifdef __AVX2__
+        return "AVX2";
+#else
+        return "SSE2";
+#endif
+    }
+
+    static void unpack565(unsigned int c, int out[4])
+    {
+        int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        out[0] = (r << 3) | (r >> 2);
+        out[1] = (g << 2) | (g >> 4);
+        out[2] = (b << 3) | (b >> 2);
+        out[3] = 255;
+    }
+
+    static unsigned int pack565(const float c[3])
+    {
+        int r = (int)(std::min(std::max(c[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+        int g = (int)(std::min(std::max(c[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+        int b = (int)(std::min(std::max(c[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+        return (unsigned int)((r << 11) | (g << 5) | b);
+    }
+
+    // copies a 4x4 block to RGBA, clamping at the image edges
+    static void gather(const unsigned char *pixels, int width, int height, int channels, int x0, int y0, unsigned char rgba[64])
+    {
+        for(int y = 0; y < 4; y++)
+        {
+            int sy = std::min(y0 + y, height - 1);
+            const unsigned char *row = pixels + (size_t)sy * width * channels;
+            for(int x = 0; x < 4; x++)
+            {
+                const unsigned char *p = row + (size_t)std::min(x0 + x, width - 1) * channels;
+                unsigned char *d = rgba + (y * 4 + x) * 4;
+                if(channels >= 3)
+                {
+                    d[0] = p[0];
+                    d[1] = p[1];
+                    d[2] = p[2];
+                }
+                else
+                    d[0] = d[1] = d[2] = p[0];
+                d[3] = (channels == 2 || channels == 4) ? p[channels - 1] : 255;
+            }
+        }
+    }
+
+    // 16 pixels as structure of arrays, 4 pixels per register
+    struct Block {
+        __m128 r[4], g[4], b[4];
+    };
+
+    static void load(const unsigned char rgba[64], Block &block)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for(int i = 0; i < 4; i++)
+        {
+            __m128i p = _mm_loadu_si128((const __m128i*)(rgba + i * 16));
+            __m128i lo = _mm_unpacklo_epi8(p, zero), hi = _mm_unpackhi_epi8(p, zero);
+            __m128 p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+            __m128 p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+            __m128 p2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+            __m128 p3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+            _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+            block.r[i] = p0;
+            block.g[i] = p1;
+            block.b[i] = p2;
+        }
+    }
+
+    static float sum(__m128 v)
+    {
+        __m128 s = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(s);
+    }
+
+    static float hmin(__m128 v)
+    {
+        __m128 s = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        s = _mm_min_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(s);
+    }
+
+    static float hmax(__m128 v)
+    {
+        __m128 s = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        s = _mm_max_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(s);
+    }
+
+    // picks the nearest of the 4 (collinear) palette entries for every pixel by projecting it onto the line
+    // between the endpoints; returns the 16 packed 2 bit indices. 'positions' receives each pixel's palette
+    // position 0..3 from palette[0] to palette[1] as a float.
+    static unsigned int selectIndices(const Block &block, const int palette[4][4], __m128 positions[4])
+    {
+        float dr = (float)(palette[1][0] - palette[0][0]), dg = (float)(palette[1][1] - palette[0][1]), db = (float)(palette[1][2] - palette[0][2]);
+        float length2 = dr * dr + dg * dg + db * db;
+        if(length2 < 1.0f)
+        {
+            for(int i = 0; i < 4; i++)
+                positions[i] = _mm_setzero_ps();
+            return 0;
+        }
+        float scale = 3.0f / length2;
+        // t = dot(p - palette[0], d) * scale = dot(p, d * scale) - dot(palette[0], d * scale), 0..3 along the line
+        float offset = -(palette[0][0] * dr + palette[0][1] * dg + palette[0][2] * db) * scale;
+#ifdef __AVX2__
+        __m256 sr = _mm256_set1_ps(dr * scale), sg = _mm256_set1_ps(dg * scale), sb = _mm256_set1_ps(db * scale);
+        __m256 so = _mm256_set1_ps(offset), zero = _mm256_setzero_ps(), three = _mm256_set1_ps(3.0f);
+        unsigned int indices = 0;
+        for(int i = 0; i < 2; i++)
+        {
+            __m256 r = _mm256_set_m128(block.r[i * 2 + 1], block.r[i * 2]);
+            __m256 g = _mm256_set_m128(block.g[i * 2 + 1], block.g[i * 2]);
+            __m256 b = _mm256_set_m128(block.b[i * 2 + 1], block.b[i * 2]);
+            // multiply and add rather than _mm256_fmadd_ps: FMA is its own instruction set, not implied by AVX2
+            __m256 t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, sr), _mm256_mul_ps(g, sg)), _mm256_add_ps(_mm256_mul_ps(b, sb), so));
+            t = _mm256_min_ps(_mm256_max_ps(t, zero), three);
+            __m256i position = _mm256_cvtps_epi32(t);
+            __m256 rounded = _mm256_cvtepi32_ps(position);
+            positions[i * 2] = _mm256_castps256_ps128(rounded);
+            positions[i * 2 + 1] = _mm256_extractf128_ps(rounded, 1);
+            // position 0..3 along the line -> DXT index order 0, 2, 3, 1
+            __m256i index = _mm256_and_si256(_mm256_add_epi32(position, _mm256_set1_epi32(1)), _mm256_set1_epi32(3));
+            index = _mm256_xor_si256(index, _mm256_xor_si256(_mm256_srli_epi32(index, 1), _mm256_set1_epi32(1)));
+            index = _mm256_sllv_epi32(index, _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14));
+            __m128i packed = _mm_or_si128(_mm256_castsi256_si128(index), _mm256_extracti128_si256(index, 1));
+            packed = _mm_or_si128(packed, _mm_shuffle_epi32(packed, _MM_SHUFFLE(1, 0, 3, 2)));
+            packed = _mm_or_si128(packed, _mm_shuffle_epi32(packed, _MM_SHUFFLE(2, 3, 0, 1)));
+            indices |= (unsigned int)_mm_cvtsi128_si32(packed) << (16 * i);
+        }
+        return indices;
+#else
+        __m128 sr = _mm_set1_ps(dr * scale), sg = _mm_set1_ps(dg * scale), sb = _mm_set1_ps(db * scale);
+        __m128 so = _mm_set1_ps(offset), zero = _mm_setzero_ps(), three = _mm_set1_ps(3.0f);
+        const __m128i one = _mm_set1_epi32(1), mask = _mm_set1_epi32(3), shifts = _mm_setr_epi32(1, 4, 16, 64);
+        unsigned int indices = 0;
+        for(int i = 0; i < 4; i++)
+        {
+            __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(block.r[i], sr), _mm_mul_ps(block.g[i], sg)),
+                                  _mm_add_ps(_mm_mul_ps(block.b[i], sb), so));
+            t = _mm_min_ps(_mm_max_ps(t, zero), three);
+            __m128i position = _mm_cvtps_epi32(t);
+            positions[i] = _mm_cvtepi32_ps(position);
+            // position 0..3 along the line -> DXT index order 0, 2, 3, 1
+            __m128i index = _mm_and_si128(_mm_add_epi32(position, one), mask);
+            index = _mm_xor_si128(index, _mm_xor_si128(_mm_srli_epi32(index, 1), one));
+            // shift each lane to its bit position (values are tiny, so a 16 bit multiply will do) and add up
+            index = _mm_mullo_epi16(index, shifts);
+            index = _mm_add_epi32(index, _mm_shuffle_epi32(index, _MM_SHUFFLE(1, 0, 3, 2)));
+            index = _mm_add_epi32(index, _mm_shuffle_epi32(index, _MM_SHUFFLE(2, 3, 0, 1)));
+            indices |= (unsigned int)_mm_cvtsi128_si32(index) << (8 * i);
+        }
+        return indices;
+#endif
+    }
+
+    // builds the 4 color palette of a (c0 > c1) endpoint pair; palette order follows the DXT index values
+    static void buildPalette(unsigned int c0, unsigned int c1, int palette[4][4])
+    {
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for(int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    }
+
+    // quantizes an endpoint pair, orders it for 4 color mode and selects indices
+    static void encodeEndpoints(const Block &block, const float e0[3], const float e1[3], unsigned int &c0, unsigned int &c1, unsigned int &indices, __m128 positions[4])
+    {
+        c0 = pack565(e0);
+        c1 = pack565(e1);
+        if(c0 < c1)
+            std::swap(c0, c1);
+        if(c0 == c1)
+        {
+            indices = 0; // 3 color mode with every pixel on entry 0
+            for(int i = 0; i < 4; i++)
+                positions[i] = _mm_setzero_ps();
+            return;
+        }
+        int palette[4][4];
+        buildPalette(c0, c1, palette);
+        indices = selectIndices(block, palette, positions);
+    }
+
+    static void encodeColorBlock(const unsigned char rgba[64], unsigned char *out)
+    {
+        Block block;
+        load(rgba, block);
+
+        // mean and covariance of the block colors
+        __m128 sr = _mm_add_ps(_mm_add_ps(block.r[0], block.r[1]), _mm_add_ps(block.r[2], block.r[3]));
+        __m128 sg = _mm_add_ps(_mm_add_ps(block.g[0], block.g[1]), _mm_add_ps(block.g[2], block.g[3]));
+        __m128 sb = _mm_add_ps(_mm_add_ps(block.b[0], block.b[1]), _mm_add_ps(block.b[2], block.b[3]));
+        float mean[3] = { sum(sr) / 16.0f, sum(sg) / 16.0f, sum(sb) / 16.0f };
+        __m128 mr = _mm_set1_ps(mean[0]), mg = _mm_set1_ps(mean[1]), mb = _mm_set1_ps(mean[2]);
+        __m128 crr = _mm_setzero_ps(), cgg = _mm_setzero_ps(), cbb = _mm_setzero_ps();
+        __m128 crg = _mm_setzero_ps(), crb = _mm_setzero_ps(), cgb = _mm_setzero_ps();
+        for(int i = 0; i < 4; i++)
+        {
+            __m128 r = _mm_sub_ps(block.r[i], mr), g = _mm_sub_ps(block.g[i], mg), b = _mm_sub_ps(block.b[i], mb);
+            crr = _mm_add_ps(crr, _mm_mul_ps(r, r));
+            cgg = _mm_add_ps(cgg, _mm_mul_ps(g, g));
+            cbb = _mm_add_ps(cbb, _mm_mul_ps(b, b));
+            crg = _mm_add_ps(crg, _mm_mul_ps(r, g));
+            crb = _mm_add_ps(crb, _mm_mul_ps(r, b));
+            cgb = _mm_add_ps(cgb, _mm_mul_ps(g, b));
+        }
+        float cov[6] = { sum(crr), sum(cgg), sum(cbb), sum(crg), sum(crb), sum(cgb) };
+
+        unsigned int c0, c1, indices;
+        __m128 positions[4];
+        if(cov[0] + cov[1] + cov[2] < 1e-3f)
+        {
+            // flat block
+            encodeEndpoints(block, mean, mean, c0, c1, indices, positions);
+            writeColorBlock(out, c0, c1, indices);
+            return;
+        }
+
+        // principal axis by power iteration, starting from the channel with the largest spread. The covariance is
+        // scaled down first so four unnormalized iterations stay well inside float range.
+        float normalize = 1.0f / (cov[0] + cov[1] + cov[2]);
+        for(int c = 0; c < 6; c++)
+            cov[c] *= normalize;
+        float axis[3] = { 0.0f, 0.0f, 0.0f };
+        axis[cov[0] >= cov[1] && cov[0] >= cov[2] ? 0 : (cov[1] >= cov[2] ? 1 : 2)] = 1.0f;
+        for(int iteration = 0; iteration < 4; iteration++)
+        {
+            float x = cov[0] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float y = cov[3] * axis[0] + cov[1] * axis[1] + cov[5] * axis[2];
+            float z = cov[4] * axis[0] + cov[5] * axis[1] + cov[2] * axis[2];
+            axis[0] = x;
+            axis[1] = y;
+            axis[2] = z;
+        }
+        float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        if(axisLength2 < 1e-20f)
+        {
+            // degenerate spread, fall back to the gray axis
+            axis[0] = axis[1] = axis[2] = 1.0f;
+            axisLength2 = 3.0f;
+        }
+
+        // endpoints at the extreme projections onto the axis
+        __m128 ar = _mm_set1_ps(axis[0]), ag = _mm_set1_ps(axis[1]), ab = _mm_set1_ps(axis[2]);
+        __m128 lo = _mm_set1_ps(1e30f), hi = _mm_set1_ps(-1e30f);
+        for(int i = 0; i < 4; i++)
+        {
+            __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(block.r[i], mr), ar),
+                                             _mm_mul_ps(_mm_sub_ps(block.g[i], mg), ag)),
+                                  _mm_mul_ps(_mm_sub_ps(block.b[i], mb), ab));
+            lo = _mm_min_ps(lo, t);
+            hi = _mm_max_ps(hi, t);
+        }
+        float tMin = hmin(lo) / axisLength2, tMax = hmax(hi) / axisLength2;
+        float e0[3], e1[3];
+        for(int c = 0; c < 3; c++)
+        {
+            e0[c] = mean[c] + axis[c] * tMax;
+            e1[c] = mean[c] + axis[c] * tMin;
+        }
+        encodeEndpoints(block, e0, e1, c0, c1, indices, positions);
+
+        // least-squares endpoints for the chosen indices: minimize sum |p - (a * e0 + (1 - a) * e1)|^2,
+        // where a = 1 - position / 3 is the weight of palette[0] in the palette entry of the pixel
+        if(c0 != c1)
+        {
+            __m128 aa = _mm_setzero_ps(), ab2 = _mm_setzero_ps(), bb = _mm_setzero_ps();
+            __m128 ax = _mm_setzero_ps(), ay = _mm_setzero_ps(), az = _mm_setzero_ps();
+            __m128 bx = _mm_setzero_ps(), by = _mm_setzero_ps(), bz = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f), third = _mm_set1_ps(1.0f / 3.0f);
+            for(int i = 0; i < 4; i++)
+            {
+                __m128 b = _mm_mul_ps(positions[i], third), a = _mm_sub_ps(one, b);
+                aa = _mm_add_ps(aa, _mm_mul_ps(a, a));
+                ab2 = _mm_add_ps(ab2, _mm_mul_ps(a, b));
+                bb = _mm_add_ps(bb, _mm_mul_ps(b, b));
+                ax = _mm_add_ps(ax, _mm_mul_ps(a, block.r[i]));
+                ay = _mm_add_ps(ay, _mm_mul_ps(a, block.g[i]));
+                az = _mm_add_ps(az, _mm_mul_ps(a, block.b[i]));
+                bx = _mm_add_ps(bx, _mm_mul_ps(b, block.r[i]));
+                by = _mm_add_ps(by, _mm_mul_ps(b, block.g[i]));
+                bz = _mm_add_ps(bz, _mm_mul_ps(b, block.b[i]));
+            }
+            float saa = sum(aa), sab = sum(ab2), sbb = sum(bb);
+            float sa[3] = { sum(ax), sum(ay), sum(az) }, sb2[3] = { sum(bx), sum(by), sum(bz) };
+            float det = saa * sbb - sab * sab;
+            if(fabsf(det) > 1e-6f)
+            {
+                float inverse = 1.0f / det;
+                for(int c = 0; c < 3; c++)
+                {
+                    e0[c] = (sa[c] * sbb - sb2[c] * sab) * inverse;
+                    e1[c] = (sb2[c] * saa - sa[c] * sab) * inverse;
+                }
+                encodeEndpoints(block, e0, e1, c0, c1, indices, positions);
+            }
+        }
+        writeColorBlock(out, c0, c1, indices);
+    }
+
+    static void writeColorBlock(unsigned char *out, unsigned int c0, unsigned int c1, unsigned int indices)
+    {
+        out[0] = (unsigned char)(c0 & 255);
+        out[1] = (unsigned char)(c0 >> 8);
+        out[2] = (unsigned char)(c1 & 255);
+        out[3] = (unsigned char)(c1 >> 8);
+        out[4] = (unsigned char)(indices & 255);
+        out[5] = (unsigned char)((indices >> 8) & 255);
+        out[6] = (unsigned char)((indices >> 16) & 255);
+        out[7] = (unsigned char)(indices >> 24);
+    }
+
+    // 8 alpha mode between the block's min and max alpha
+    static void encodeAlphaBlock(const unsigned char rgba[64], unsigned char *out)
+    {
+        int a0 = 0, a1 = 255;
+        for(int i = 0; i < 16; i++)
+        {
+            a0 = std::max(a0, (int)rgba[i * 4 + 3]);
+            a1 = std::min(a1, (int)rgba[i * 4 + 3]);
+        }
+        out[0] = (unsigned char)a0;
+        out[1] = (unsigned char)a1;
+        unsigned long long bits = 0;
+        if(a0 > a1)
+        {
+            int range = a0 - a1;
+            for(int i = 0; i < 16; i++)
+            {
+                // step 0..7 from a1 towards a0, mapped to the DXT5 index order (0 = a0, 1 = a1, 2..7 in between)
+                int step = ((rgba[i * 4 + 3] - a1) * 14 + range) / (2 * range);
+                int index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+                bits |= (unsigned long long)index << (3 * i);
+            }
+        }
+        for(int i = 0; i < 6; i++)
+            out[2 + i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    static double rmse(const unsigned char *pixels, int width, int height, int channels, const unsigned char *blocks)
+    {
+        int blocksX = (width + 3) / 4;
+        double total = 0.0;
+        for(int y = 0; y < height; y += 4)
+        {
+            for(int x = 0; x < width; x += 4)
+            {
+                unsigned char decoded[64], source[64];
+                decodeColorBlock(blocks + ((size_t)(y / 4) * blocksX + x / 4) * 8, decoded);
+                gather(pixels, width, height, channels, x, y, source);
+                for(int j = 0; j < 4 && y + j < height; j++)
+                    for(int i = 0; i < 4 && x + i < width; i++)
+                        for(int c = 0; c < 3; c++)
+                        {
+                            double d = (double)decoded[(j * 4 + i) * 4 + c] - source[(j * 4 + i) * 4 + c];
+                            total += d * d;
+                        }
+            }
+        }
+        return sqrt(total / ((double)width * height * 3));
+    }
+};
+#endif
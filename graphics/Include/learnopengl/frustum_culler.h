@@ -0,0 +1,187 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <emmintrin.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <atomic>
+#include <cmath>
+using namespace std;
+
+// Tests bounding volumes against the six planes of a view frustum. The planes are kept as four arrays (x, y, z
+// and w of every plane, padded to 8 by repeating planes) so one SSE register tests four planes at once, and
+// cullInstances() tests four instances against a plane per instruction. Spheres and boxes that are only partly
+// inside count as visible. Counters of what was tested add up until resetCounters(); main resets them per frame.
+// Once the planes are set, any number of threads can test against them at once.
+class FrustumCuller
+{
+public:
+    // meshes (or whole models) and instances found visible and culled since the last resetCounters()
+    atomic<unsigned int> visibleObjects, culledObjects;
+    atomic<unsigned int> visibleInstances, culledInstances;
+
+    FrustumCuller()
+    {
+        resetCounters();
+        setViewProjection(glm::mat4(1.0f));
+    }
+
+    // extracts the planes of 'projection * view' (Gribb & Hartmann), normals pointing inwards and normalized
+    void setViewProjection(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 row[4];
+        for(int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        glm::vec4 planes[6] = { row[3] + row[0], row[3] - row[0], row[3] + row[1], row[3] - row[1], row[3] + row[2], row[3] - row[2] };
+        setPlanes(planes, worldPlanes);
+    }
+
+    // whether a sphere in world space is at least partly inside
+    bool sphereVisible(const glm::vec3 &center, float radius) const
+    {
+        __m128 x = _mm_set1_ps(center.x), y = _mm_set1_ps(center.y), z = _mm_set1_ps(center.z);
+        __m128 minusRadius = _mm_set1_ps(-radius);
+        for(int i = 0; i < PLANE_SLOTS; i += 4)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(worldPlanes.x + i), x), _mm_mul_ps(_mm_load_ps(worldPlanes.y + i), y)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_load_ps(worldPlanes.z + i), z), _mm_load_ps(worldPlanes.w + i)));
+            if(_mm_movemask_ps(_mm_cmplt_ps(distance, minusRadius)))
+                return false;
+        }
+        return true;
+    }
+
+    // whether an object space box placed by the affine 'model' matrix is at least partly inside. The box is
+    // widened to the world space box around it (Arvo), then tested like a sphere with a per plane radius.
+    bool boxVisible(const glm::mat4 &model, const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+    {
+        glm::vec3 center = glm::vec3(model * glm::vec4((boxMin + boxMax) * 0.5f, 1.0f));
+        glm::vec3 halfSize = (boxMax - boxMin) * 0.5f;
+        glm::vec3 extent(0.0f);
+        for(int column = 0; column < 3; column++)
+            extent += glm::abs(glm::vec3(model[column])) * halfSize[column];
+
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        __m128 x = _mm_set1_ps(center.x), y = _mm_set1_ps(center.y), z = _mm_set1_ps(center.z);
+        __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+        for(int i = 0; i < PLANE_SLOTS; i += 4)
+        {
+            __m128 px = _mm_load_ps(worldPlanes.x + i), py = _mm_load_ps(worldPlanes.y + i), pz = _mm_load_ps(worldPlanes.z + i);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, x), _mm_mul_ps(py, y)), _mm_add_ps(_mm_mul_ps(pz, z), _mm_load_ps(worldPlanes.w + i)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex), _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)),
+                                       _mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+            if(_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())))
+                return false;
+        }
+        return true;
+    }
+
+    // tests a mesh drawn with 'model': its bounding sphere first, then its box. Counts the result.
+    bool meshVisible(const Mesh &mesh, const glm::mat4 &model)
+    {
+        float scale = maxScale(model);
+        bool visible = sphereVisible(glm::vec3(model * glm::vec4(glm::vec3(mesh.bounds), 1.0f)), mesh.bounds.w * scale) &&
+                       boxVisible(model, mesh.boxMin, mesh.boxMax);
+        if(visible)
+            visibleObjects++;
+        else
+            culledObjects++;
+        return visible;
+    }
+
+    // copies the instances whose bounding sphere is at least partly inside to 'visible' (room for 'count') and
+    // returns how many there are. 'meshBounds' is the sphere around the instanced mesh in its own space; an
+    // instance's sphere is centered on the instance and covers the mesh under any rotation.
+    unsigned int cullInstances(const MeshInstance *instances, unsigned int count, const glm::vec4 &meshBounds, const glm::mat4 &model,
+                               MeshInstance *visible)
+    {
+        // the planes in the instances' space: a plane p transforms with transpose(model)
+        glm::mat4 transposed = glm::transpose(model);
+        glm::vec4 planes[PLANE_SLOTS];
+        for(int i = 0; i < PLANE_SLOTS; i++)
+            planes[i] = transposed * glm::vec4(worldPlanes.x[i], worldPlanes.y[i], worldPlanes.z[i], worldPlanes.w[i]);
+        Planes local;
+        setPlanes(planes, local);
+
+        float meshRadius = glm::length(glm::vec3(meshBounds)) + meshBounds.w;
+        __m128 minusMeshRadius = _mm_set1_ps(-meshRadius);
+        unsigned int written = 0, i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            // positions and scales of four instances, transposed to x, y, z and s registers
+            __m128 x = _mm_loadu_ps(&instances[i].positionScale.x);
+            __m128 y = _mm_loadu_ps(&instances[i + 1].positionScale.x);
+            __m128 z = _mm_loadu_ps(&instances[i + 2].positionScale.x);
+            __m128 s = _mm_loadu_ps(&instances[i + 3].positionScale.x);
+            _MM_TRANSPOSE4_PS(x, y, z, s);
+            __m128 minusRadius = _mm_mul_ps(s, minusMeshRadius);
+            __m128 outside = _mm_setzero_ps();
+            for(int p = 0; p < PLANES; p++)
+            {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(local.x[p]), x), _mm_mul_ps(_mm_set1_ps(local.y[p]), y)),
+                                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(local.z[p]), z), _mm_set1_ps(local.w[p])));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, minusRadius));
+            }
+            int mask = ~_mm_movemask_ps(outside) & 15;
+            for(int j = 0; j < 4; j++)
+                if(mask & (1 << j))
+                    visible[written++] = instances[i + j];
+        }
+        for(; i < count; i++)
+        {
+            const glm::vec4 &instance = instances[i].positionScale;
+            bool inside = true;
+            for(int p = 0; p < PLANES && inside; p++)
+                inside = local.x[p] * instance.x + local.y[p] * instance.y + local.z[p] * instance.z + local.w[p] >= -instance.w * meshRadius;
+            if(inside)
+                visible[written++] = instances[i];
+        }
+        visibleInstances += written;
+        culledInstances += count - written;
+        return written;
+    }
+
+    void resetCounters()
+    {
+        visibleObjects = culledObjects = 0;
+        visibleInstances = culledInstances = 0;
+    }
+
+    // largest factor by which an affine matrix scales lengths along an axis
+    static float maxScale(const glm::mat4 &model)
+    {
+        return max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    }
+
+private:
+    static const int PLANES = 6;
+    static const int PLANE_SLOTS = 8;
+
+    struct Planes {
+        alignas(16) float x[PLANE_SLOTS];
+        alignas(16) float y[PLANE_SLOTS];
+        alignas(16) float z[PLANE_SLOTS];
+        alignas(16) float w[PLANE_SLOTS];
+    };
+    Planes worldPlanes;
+
+    // normalizes the planes and stores them in 'out', repeating the first ones in the padding slots
+    static void setPlanes(const glm::vec4 *planes, Planes &out)
+    {
+        for(int i = 0; i < PLANE_SLOTS; i++)
+        {
+            glm::vec4 plane = planes[i % PLANES];
+            float length = glm::length(glm::vec3(plane));
+            if(length > 0.0f)
+                plane /= length;
+            out.x[i] = plane.x;
+            out.y[i] = plane.y;
+            out.z[i] = plane.z;
+            out.w[i] = plane.w;
+        }
+    }
+};
+#endif
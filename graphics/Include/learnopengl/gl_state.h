@@ -0,0 +1,208 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// Shadow copy of the GL bindings the renderer changes most: the program, the vertex array, the active texture
+// unit and the 2D texture and sampler of each unit, and the generic and indexed buffer bindings. A bind that
+// matches the shadow is skipped, so callers can state what they need before every draw without paying for it
+// twice. Everything that binds these objects must go through GLState::get() (there is a single GL context),
+// otherwise the shadow goes stale; call invalidate() after code that doesn't.
+// issued()/elided() count the binds since the last resetCounters(), per frame when main resets them.
+class GLState
+{
+public:
+    // texture units and indexed buffer binding points that are tracked; others are passed straight through
+    static const unsigned int MAX_UNITS = 32;
+    static const unsigned int MAX_BUFFER_BINDINGS = 16;
+
+    static GLState &get()
+    {
+        static GLState state;
+        return state;
+    }
+
+    void useProgram(unsigned int program)
+    {
+        if(track(program, currentProgram))
+            glUseProgram(program);
+    }
+
+    void bindVertexArray(unsigned int vao)
+    {
+        if(track(vao, currentVertexArray))
+            glBindVertexArray(vao);
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if(unit >= MAX_UNITS ? untracked(unit, currentUnit) : track(unit, currentUnit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // binds 'texture' to 'target' of the active unit
+    void bindTexture(GLenum target, unsigned int texture)
+    {
+        bool tracked = target == GL_TEXTURE_2D && currentUnit < MAX_UNITS;
+        if(tracked ? track(texture, textures[currentUnit]) : untracked())
+            glBindTexture(target, texture);
+    }
+
+    // binds 'texture' to 'target' of 'unit'; the unit only becomes active if the binding has to change
+    void bindTexture(unsigned int unit, GLenum target, unsigned int texture)
+    {
+        if(unit < MAX_UNITS && target == GL_TEXTURE_2D && textures[unit] == texture)
+        {
+            elidedCount++;
+            return;
+        }
+        activeTexture(unit);
+        bindTexture(target, texture);
+    }
+
+    void bindSampler(unsigned int unit, unsigned int sampler)
+    {
+        if(unit >= MAX_UNITS ? untracked() : track(sampler, samplers[unit]))
+            glBindSampler(unit, sampler);
+    }
+
+    // generic buffer bindings. GL_ELEMENT_ARRAY_BUFFER belongs to the bound vertex array and is not tracked.
+    void bindBuffer(GLenum target, unsigned int buffer)
+    {
+        unsigned int *current = bufferBinding(target);
+        if(current ? track(buffer, *current) : untracked())
+            glBindBuffer(target, buffer);
+    }
+
+    // indexed binding point of GL_UNIFORM_BUFFER (and other indexed targets); also sets the generic binding
+    void bindBufferBase(GLenum target, unsigned int index, unsigned int buffer)
+    {
+        unsigned int *current = target == GL_UNIFORM_BUFFER && index < MAX_BUFFER_BINDINGS ? &uniformBuffers[index] : NULL;
+        if(current ? track(buffer, *current) : untracked())
+        {
+            glBindBufferBase(target, index, buffer);
+            if(unsigned int *generic = bufferBinding(target))
+                *generic = buffer;
+        }
+    }
+
+    // deleting an object unbinds it everywhere, so these also clear it from the shadow
+    void deleteTextures(unsigned int count, const unsigned int *ids)
+    {
+        for(unsigned int i = 0; i < count; i++)
+            for(unsigned int unit = 0; unit < MAX_UNITS; unit++)
+                if(textures[unit] == ids[i])
+                    textures[unit] = 0;
+        glDeleteTextures(count, ids);
+    }
+
+    void deleteBuffers(unsigned int count, const unsigned int *ids)
+    {
+        for(unsigned int i = 0; i < count; i++)
+        {
+            for(unsigned int j = 0; j < BUFFER_TARGETS; j++)
+                if(buffers[j] == ids[i])
+                    buffers[j] = 0;
+            for(unsigned int j = 0; j < MAX_BUFFER_BINDINGS; j++)
+                if(uniformBuffers[j] == ids[i])
+                    uniformBuffers[j] = UNKNOWN; // whether indexed bindings are dropped depends on the GL version
+        }
+        glDeleteBuffers(count, ids);
+    }
+
+    void deleteVertexArrays(unsigned int count, const unsigned int *ids)
+    {
+        for(unsigned int i = 0; i < count; i++)
+            if(currentVertexArray == ids[i])
+                currentVertexArray = 0;
+        glDeleteVertexArrays(count, ids);
+    }
+
+    // forgets all bindings, the next bind of each kind is issued
+    void invalidate()
+    {
+        currentProgram = UNKNOWN;
+        currentVertexArray = UNKNOWN;
+        currentUnit = UNKNOWN;
+        for(unsigned int i = 0; i < MAX_UNITS; i++)
+        {
+            textures[i] = UNKNOWN;
+            samplers[i] = UNKNOWN;
+        }
+        for(unsigned int i = 0; i < BUFFER_TARGETS; i++)
+            buffers[i] = UNKNOWN;
+        for(unsigned int i = 0; i < MAX_BUFFER_BINDINGS; i++)
+            uniformBuffers[i] = UNKNOWN;
+    }
+
+    unsigned int issued() const { return issuedCount; }
+    unsigned int elided() const { return elidedCount; }
+    void resetCounters()
+    {
+        issuedCount = 0;
+        elidedCount = 0;
+    }
+
+private:
+    static const unsigned int UNKNOWN = 0xFFFFFFFFu;
+    enum { ARRAY_BUFFER, UNIFORM_BUFFER, PIXEL_PACK_BUFFER, PIXEL_UNPACK_BUFFER, COPY_READ_BUFFER, COPY_WRITE_BUFFER, BUFFER_TARGETS };
+
+    unsigned int currentProgram;
+    unsigned int currentVertexArray;
+    unsigned int currentUnit;
+    unsigned int textures[MAX_UNITS];
+    unsigned int samplers[MAX_UNITS];
+    unsigned int buffers[BUFFER_TARGETS];
+    unsigned int uniformBuffers[MAX_BUFFER_BINDINGS];
+    unsigned int issuedCount;
+    unsigned int elidedCount;
+
+    GLState() : issuedCount(0), elidedCount(0)
+    {
+        invalidate();
+    }
+
+    // records 'value' in 'current'; true if it changed and the GL call has to be made
+    bool track(unsigned int value, unsigned int &current)
+    {
+        if(current == value)
+        {
+            elidedCount++;
+            return false;
+        }
+        current = value;
+        issuedCount++;
+        return true;
+    }
+
+    // counts a call whose state isn't tracked; it is always made
+    bool untracked()
+    {
+        issuedCount++;
+        return true;
+    }
+
+    bool untracked(unsigned int value, unsigned int &current)
+    {
+        current = value;
+        return untracked();
+    }
+
+    unsigned int *bufferBinding(GLenum target)
+    {
+        switch(target)
+        {
+        case GL_ARRAY_BUFFER: return &buffers[ARRAY_BUFFER];
+        case GL_UNIFORM_BUFFER: return &buffers[UNIFORM_BUFFER];
+        case GL_PIXEL_PACK_BUFFER: return &buffers[PIXEL_PACK_BUFFER];
+        case GL_PIXEL_UNPACK_BUFFER: return &buffers[PIXEL_UNPACK_BUFFER];
+        case GL_COPY_READ_BUFFER: return &buffers[COPY_READ_BUFFER];
+        case GL_COPY_WRITE_BUFFER: return &buffers[COPY_WRITE_BUFFER];
+        default: return NULL;
+        }
+    }
+
+    GLState(const GLState&);
+    GLState& operator=(const GLState&);
+};
+#endif
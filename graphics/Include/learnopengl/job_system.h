@@ -0,0 +1,271 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Work-stealing job scheduler for the per-frame CPU work
+// -------------------------------------------------------
+// Every thread (the workers and the thread that created the system, which joins in while it waits) has its own
+// deque of runnable jobs. A thread pushes the jobs it runs onto the back of its own deque and takes work from the
+// back (the most recent, still in cache); an idle thread steals from the front of another's (the oldest, usually
+// the biggest piece of work left). Workers with nothing to do sleep until a job is pushed.
+//
+//     JobSystem::Job *a = jobs.create([&]() { ... });
+//     JobSystem::Job *b = jobs.create([&]() { ... });
+//     jobs.depend(b, a);      // b starts once a has finished
+//     jobs.run(a);
+//     jobs.run(b);
+//     jobs.wait(b);           // runs other jobs until b is done
+//
+// Jobs come from a ring of MAX_JOBS that is reused, and their work (a lambda, usually capturing by reference) is
+// copied into the job, so scheduling allocates nothing; at most MAX_JOBS jobs may be alive at once. A job is
+// finished when its work and those of its children (see parallelFor()) have returned.
+class JobSystem
+{
+public:
+    enum { MAX_JOBS = 4096, MAX_DEPENDENTS = 8, STORAGE_BYTES = 160 };
+
+    struct Job {
+        void (*call)(Job*);                 // runs the work stored in 'storage' and destroys it
+        atomic<int> unfinished;             // the job itself and its children that haven't returned
+        atomic<int> blockers;               // dependencies not finished, plus one until run()
+        Job *parent;
+        Job *dependents[MAX_DEPENDENTS];
+        atomic<unsigned int> dependentCount;
+        alignas(16) unsigned char storage[STORAGE_BYTES];
+    };
+
+    // 'threadCount' threads in all, the calling thread included (one per hardware thread when 0)
+    explicit JobSystem(unsigned int threadCount = 0) : jobs(MAX_JOBS), nextJob(0), queued(0), stopping(false)
+    {
+        if(threadCount == 0)
+            threadCount = thread::hardware_concurrency();
+        if(threadCount == 0)
+            threadCount = 2;
+        queues = vector<Queue>(threadCount);
+        currentSystem() = this;
+        currentIndex() = 0;
+        for(unsigned int i = 1; i < threadCount; i++)
+            workers.push_back(thread(&JobSystem::workerLoop, this, i));
+    }
+
+    ~JobSystem()
+    {
+        {
+            lock_guard<mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+        if(currentSystem() == this)
+            currentSystem() = NULL;
+    }
+
+    // a job that will call 'work' (copied into the job, at most STORAGE_BYTES); it starts after run()
+    template<class Work> Job *create(const Work &work)
+    {
+        static_assert(sizeof(Work) <= STORAGE_BYTES, "job work too large, capture less or by reference");
+        Job *job = &jobs[nextJob++ % MAX_JOBS];
+        // the ring wrapped onto a job that is still alive: more than MAX_JOBS at once
+        assert(finished(job));
+        job->call = &callWork<Work>;
+        job->unfinished = 1;
+        job->blockers = 1;
+        job->parent = NULL;
+        job->dependentCount = 0;
+        new (job->storage) Work(work);
+        return job;
+    }
+
+    // 'job' starts only after 'dependency' has finished; call before running either
+    void depend(Job *job, Job *dependency)
+    {
+        assert(dependency->dependentCount < MAX_DEPENDENTS);
+        job->blockers++;
+        dependency->dependents[dependency->dependentCount++] = job;
+    }
+
+    // queues 'job' (on this thread's deque) once its dependencies have finished
+    void run(Job *job)
+    {
+        if(--job->blockers == 0)
+            push(job);
+    }
+
+    bool finished(const Job *job) const { return job->unfinished.load() == 0; }
+
+    // runs queued jobs until 'job' has finished
+    void wait(const Job *job)
+    {
+        while(!finished(job))
+        {
+            Job *next = find(queueIndex());
+            if(next)
+                execute(next);
+            else
+                this_thread::yield();
+        }
+    }
+
+    // calls body(first, last) for chunks of 'grain' items of 0..count and returns when all have returned. The
+    // chunks are handed out through a counter to one job per thread, so a thread that finishes early takes more;
+    // the calling thread works on them too.
+    template<class Body> void parallelFor(unsigned int count, unsigned int grain, const Body &body)
+    {
+        unsigned int chunks = (count + grain - 1) / grain;
+        unsigned int tasks = min(threadCount(), chunks);
+        if(tasks <= 1)
+        {
+            if(count)
+                body(0u, count);
+            return;
+        }
+        atomic<unsigned int> next(0);
+        Job *all = create([]() {});
+        for(unsigned int t = 0; t < tasks; t++)
+        {
+            Job *task = create([&]()
+            {
+                for(unsigned int chunk = next++; chunk < chunks; chunk = next++)
+                    body(chunk * grain, min(chunk * grain + grain, count));
+            });
+            task->parent = all;
+            all->unfinished++;
+            run(task);
+        }
+        run(all);
+        wait(all);
+    }
+
+    unsigned int threadCount() const { return (unsigned int)queues.size(); }
+
+private:
+    // one thread's deque, a ring of MAX_JOBS; the owner pushes and pops at the back, thieves take the front
+    struct Queue {
+        mutex lock;
+        Job *ring[MAX_JOBS];
+        unsigned int front, back;
+        Queue() : front(0), back(0)
+        {
+        }
+        Queue(const Queue&) : front(0), back(0)
+        {
+        }
+    };
+
+    vector<Job> jobs;               // value-initialized, so every slot starts out finished
+    atomic<unsigned int> nextJob;
+    vector<Queue> queues;
+    vector<thread> workers;
+    atomic<int> queued;             // jobs in all the deques
+    mutex sleepMutex;
+    condition_variable wake;
+    bool stopping;
+
+    template<class Work> static void callWork(Job *job)
+    {
+        Work *work = reinterpret_cast<Work*>(job->storage);
+        (*work)();
+        work->~Work();
+    }
+
+    // the system and deque of the calling thread
+    static JobSystem *&currentSystem()
+    {
+        static thread_local JobSystem *system = NULL;
+        return system;
+    }
+    static unsigned int &currentIndex()
+    {
+        static thread_local unsigned int index = 0;
+        return index;
+    }
+    // threads that aren't part of this system push onto the creating thread's deque
+    unsigned int queueIndex() const
+    {
+        return currentSystem() == this ? currentIndex() : 0;
+    }
+
+    void push(Job *job)
+    {
+        Queue &queue = queues[queueIndex()];
+        {
+            lock_guard<mutex> lock(queue.lock);
+            queue.ring[queue.back++ % MAX_JOBS] = job;
+        }
+        queued++;
+        {
+            lock_guard<mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // the newest job of our own deque, else the oldest of another's
+    Job *find(unsigned int self)
+    {
+        if(queued.load() == 0)
+            return NULL;
+        for(unsigned int i = 0; i < queues.size(); i++)
+        {
+            Queue &queue = queues[(self + i) % queues.size()];
+            lock_guard<mutex> lock(queue.lock);
+            if(queue.front == queue.back)
+                continue;
+            Job *job = i == 0 ? queue.ring[--queue.back % MAX_JOBS] : queue.ring[queue.front++ % MAX_JOBS];
+            queued--;
+            return job;
+        }
+        return NULL;
+    }
+
+    void execute(Job *job)
+    {
+        job->call(job);
+        finish(job);
+    }
+
+    // one part of 'job' is done; when it was the last, its dependents may start and its parent is told
+    void finish(Job *job)
+    {
+        if(--job->unfinished > 0)
+            return;
+        unsigned int dependents = job->dependentCount;
+        Job *parent = job->parent;
+        for(unsigned int i = 0; i < dependents; i++)
+            run(job->dependents[i]);
+        if(parent)
+            finish(parent);
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        currentSystem() = this;
+        currentIndex() = index;
+        for(;;)
+        {
+            Job *job = find(index);
+            if(job)
+            {
+                execute(job);
+                continue;
+            }
+            unique_lock<mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if(stopping)
+                return;
+        }
+    }
+
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+};
+#endif
@@ -0,0 +1,345 @@
+#ifndef KEPLER_ORBITS_H
+#define KEPLER_ORBITS_H
+
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+
+// the orbit of one body about its parent
+struct KeplerElements {
+    float semiMajorAxis;    // a
+    float eccentricity;     // e, 0 (circle) to below 1
+    float inclination;      // i, radians, tilt of the orbit against the parent's xz plane
+    float ascendingNode;    // longitude of the ascending node (Omega), radians
+    float periapsis;        // argument of periapsis (omega), radians
+    float meanAnomaly;      // M0, radians, at time 0
+    float meanMotion;       // n, radians of mean anomaly per unit of time
+};
+
+// the vector operations the propagation kernel is written in: 8 lanes with /arch:AVX2, 4 lanes of SSE2 otherwise
+struct KeplerLanes
+{
+#ifdef __AVX2__
+    typedef __m256 Float;
+    typedef __m256i Int;
+    enum { WIDTH = 8 };
+    static Float load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, Float a) { _mm256_storeu_ps(p, a); }
+    static Float set(float a) { return _mm256_set1_ps(a); }
+    static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    // FMA is its own instruction set, not implied by AVX2
+#ifdef __FMA__
+    static Float mulAdd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+    static Float mulAdd(Float a, Float b, Float c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+    static Float bitAnd(Float a, Float b) { return _mm256_and_ps(a, b); }
+    static Float bitOr(Float a, Float b) { return _mm256_or_ps(a, b); }
+    static Float bitXor(Float a, Float b) { return _mm256_xor_ps(a, b); }
+    static Float select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+    static Int round(Float a) { return _mm256_cvtps_epi32(a); }
+    static Float toFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+    static Float bits(Int a) { return _mm256_castsi256_ps(a); }
+    static Int setInt(int a) { return _mm256_set1_epi32(a); }
+    static Int addInt(Int a, Int b) { return _mm256_add_epi32(a, b); }
+    static Int andInt(Int a, Int b) { return _mm256_and_si256(a, b); }
+    static Int equalInt(Int a, Int b) { return _mm256_cmpeq_epi32(a, b); }
+    static Int shiftLeft30(Int a) { return _mm256_slli_epi32(a, 30); }
+#else
+    typedef __m128 Float;
+    typedef __m128i Int;
+    enum { WIDTH = 4 };
+    static Float load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, Float a) { _mm_storeu_ps(p, a); }
+    static Float set(float a) { return _mm_set1_ps(a); }
+    static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+    static Float mulAdd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static Float bitAnd(Float a, Float b) { return _mm_and_ps(a, b); }
+    static Float bitOr(Float a, Float b) { return _mm_or_ps(a, b); }
+    static Float bitXor(Float a, Float b) { return _mm_xor_ps(a, b); }
+    static Float select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static Int round(Float a) { return _mm_cvtps_epi32(a); }
+    static Float toFloat(Int a) { return _mm_cvtepi32_ps(a); }
+    static Float bits(Int a) { return _mm_castsi128_ps(a); }
+    static Int setInt(int a) { return _mm_set1_epi32(a); }
+    static Int addInt(Int a, Int b) { return _mm_add_epi32(a, b); }
+    static Int andInt(Int a, Int b) { return _mm_and_si128(a, b); }
+    static Int equalInt(Int a, Int b) { return _mm_cmpeq_epi32(a, b); }
+    static Int shiftLeft30(Int a) { return _mm_slli_epi32(a, 30); }
+#endif
+};
+
+// Keplerian orbits, propagated analytically in batches
+// -----------------------------------------------------
+// Each orbit is reduced at add() time to what the propagation needs, stored as structure-of-arrays: the
+// eccentricity, M0, n and the perifocal axes P (towards periapsis) and Q (90 degrees ahead in the orbit's
+// plane), premultiplied by a and by the semi-minor axis b = a sqrt(1 - e^2). The position at time t is then
+//
+//     M = M0 + n t,   E - e sin E = M (Kepler's equation),   position = (cos E - e) P + sin E Q
+//
+// propagate() does this for AVX2 or SSE2 lanes of orbits at once: M wrapped to -pi..pi, Danby's starting guess
+// E = M + 0.85 e sign(M) and a fixed number of Newton steps, so every lane takes the same path; sin and cos are
+// a shared polynomial evaluation after reduction to -pi/4..pi/4. Single precision throughout, checked against
+// the scalar double precision reference() by benchmark() (--bench-kepler).
+//
+// The elements are in the usual frame with z towards the parent's north; positions come out in the y-up frame
+// of the scene (x, z, -y), so a circle with no inclination turns the same way glm::rotate about +y does.
+class KeplerOrbits
+{
+public:
+    // Newton steps; enough for single precision up to e = 0.95 from Danby's guess
+    enum { NEWTON_STEPS = 5 };
+
+    KeplerOrbits() : count(0)
+    {
+    }
+
+    // adds an orbit and returns its index
+    unsigned int add(const KeplerElements &orbit)
+    {
+        unsigned int index = count++;
+        // pad to whole lanes; padding orbits sit at the origin
+        if(paddedSize() > eccentricity.size())
+            resizeArrays(paddedSize());
+        orbits.push_back(orbit);
+        set(index, orbit);
+        return index;
+    }
+
+    void set(unsigned int index, const KeplerElements &orbit)
+    {
+        orbits[index] = orbit;
+        double cosNode = cos((double)orbit.ascendingNode), sinNode = sin((double)orbit.ascendingNode);
+        double cosPeri = cos((double)orbit.periapsis), sinPeri = sin((double)orbit.periapsis);
+        double cosInc = cos((double)orbit.inclination), sinInc = sin((double)orbit.inclination);
+        double a = orbit.semiMajorAxis, b = a * sqrt(max(1.0 - (double)orbit.eccentricity * orbit.eccentricity, 0.0));
+        glm::dvec3 p = sceneFrame(glm::dvec3(cosNode * cosPeri - sinNode * sinPeri * cosInc, sinNode * cosPeri + cosNode * sinPeri * cosInc, sinPeri * sinInc));
+        glm::dvec3 q = sceneFrame(glm::dvec3(-cosNode * sinPeri - sinNode * cosPeri * cosInc, -sinNode * sinPeri + cosNode * cosPeri * cosInc, cosPeri * sinInc));
+        axisPX[index] = (float)(p.x * a);
+        axisPY[index] = (float)(p.y * a);
+        axisPZ[index] = (float)(p.z * a);
+        axisQX[index] = (float)(q.x * b);
+        axisQY[index] = (float)(q.y * b);
+        axisQZ[index] = (float)(q.z * b);
+        eccentricity[index] = orbit.eccentricity;
+        meanAnomaly[index] = orbit.meanAnomaly;
+        meanMotion[index] = orbit.meanMotion;
+    }
+
+    const KeplerElements &elements(unsigned int index) const { return orbits[index]; }
+    unsigned int size() const { return count; }
+    // size() rounded up to whole lanes: the room propagate() needs in its output arrays
+    unsigned int paddedSize() const { return (count + KeplerLanes::WIDTH - 1) / KeplerLanes::WIDTH * KeplerLanes::WIDTH; }
+
+    void clear()
+    {
+        count = 0;
+        orbits.clear();
+        resizeArrays(0);
+    }
+
+    // positions at 'time' of the orbits first..last (widened to whole lanes), written to x, y and z at the
+    // orbits' indices. Different ranges can be propagated on different threads.
+    void propagate(float time, float *x, float *y, float *z, unsigned int first = 0, unsigned int last = ~0u) const
+    {
+        typedef KeplerLanes L;
+        last = min(last, count);
+        const L::Float t = L::set(time);
+        const L::Float twoPi = L::set(6.2831853f), inverseTwoPi = L::set(1.0f / 6.2831853f);
+        // 2 pi - float(2 pi), so the wrap loses no precision
+        const L::Float twoPiLow = L::set(-1.7484555e-7f);
+        const L::Float signBit = L::set(-0.0f), one = L::set(1.0f), guess = L::set(0.85f);
+        for(unsigned int i = first / L::WIDTH * L::WIDTH; i < last; i += L::WIDTH)
+        {
+            L::Float e = L::load(&eccentricity[i]);
+            L::Float M = L::mulAdd(L::load(&meanMotion[i]), t, L::load(&meanAnomaly[i]));
+            L::Float turns = L::toFloat(L::round(L::mul(M, inverseTwoPi)));
+            M = L::sub(L::sub(M, L::mul(turns, twoPi)), L::mul(turns, twoPiLow));
+
+            L::Float E = L::add(M, L::bitOr(L::bitAnd(M, signBit), L::mul(guess, e)));
+            L::Float sinE, cosE;
+            for(int step = 0; step < NEWTON_STEPS; step++)
+            {
+                sinCos(E, sinE, cosE);
+                // E -= (E - e sin E - M) / (1 - e cos E)
+                L::Float f = L::sub(L::sub(E, L::mul(e, sinE)), M);
+                E = L::sub(E, L::div(f, L::sub(one, L::mul(e, cosE))));
+            }
+            sinCos(E, sinE, cosE);
+
+            L::Float alongP = L::sub(cosE, e);
+            L::store(x + i, L::mulAdd(alongP, L::load(&axisPX[i]), L::mul(sinE, L::load(&axisQX[i]))));
+            L::store(y + i, L::mulAdd(alongP, L::load(&axisPY[i]), L::mul(sinE, L::load(&axisQY[i]))));
+            L::store(z + i, L::mulAdd(alongP, L::load(&axisPZ[i]), L::mul(sinE, L::load(&axisQZ[i]))));
+        }
+    }
+
+    // position of one orbit at 'time', in double precision with std::sin and std::cos and Newton run to
+    // convergence: what propagate() is checked against
+    glm::dvec3 reference(unsigned int index, double time) const
+    {
+        const double PI = 3.14159265358979323846;
+        const KeplerElements &orbit = orbits[index];
+        double e = orbit.eccentricity;
+        double M = fmod((double)orbit.meanAnomaly + (double)orbit.meanMotion * time, 2.0 * PI);
+        double E = e < 0.8 ? M : PI;
+        for(int step = 0; step < 50; step++)
+        {
+            double delta = (E - e * sin(E) - M) / (1.0 - e * cos(E));
+            E -= delta;
+            if(fabs(delta) < 1e-15)
+                break;
+        }
+        double cosNode = cos((double)orbit.ascendingNode), sinNode = sin((double)orbit.ascendingNode);
+        double cosPeri = cos((double)orbit.periapsis), sinPeri = sin((double)orbit.periapsis);
+        double cosInc = cos((double)orbit.inclination), sinInc = sin((double)orbit.inclination);
+        // in the orbit's plane, then rotated by omega, i and Omega
+        double a = orbit.semiMajorAxis;
+        double px = a * (cos(E) - e), py = a * sqrt(1.0 - e * e) * sin(E);
+        double x1 = px * cosPeri - py * sinPeri, y1 = px * sinPeri + py * cosPeri;
+        double x2 = x1, y2 = y1 * cosInc, z2 = y1 * sinInc;
+        return sceneFrame(glm::dvec3(x2 * cosNode - y2 * sinNode, x2 * sinNode + y2 * cosNode, z2));
+    }
+
+    // bodies per millisecond of propagate() and of the double precision reference at 1k, 100k and 1M random
+    // orbits (e up to 0.95), and the largest position error relative to the semi-major axis. Fails above 1e-4.
+    static bool benchmark(ostream &log)
+    {
+        const unsigned int SIZES[] = { 1000, 100000, 1000000 };
+        const double MAX_ERROR = 1e-4;
+        mt19937 random(7);
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+        bool ok = true;
+        log << "Kepler propagation (" << simdName() << ", 1 thread, " << NEWTON_STEPS << " Newton steps)" << endl;
+        log << "    bodies   propagate bodies/ms   reference bodies/ms   speedup   max error / a" << endl;
+        for(int s = 0; s < 3; s++)
+        {
+            KeplerOrbits batch;
+            for(unsigned int i = 0; i < SIZES[s]; i++)
+            {
+                KeplerElements orbit;
+                orbit.semiMajorAxis = 1.0f + 99.0f * unit(random);
+                orbit.eccentricity = 0.95f * unit(random);
+                orbit.inclination = 3.1415927f * unit(random);
+                orbit.ascendingNode = 6.2831853f * unit(random);
+                orbit.periapsis = 6.2831853f * unit(random);
+                orbit.meanAnomaly = 6.2831853f * unit(random);
+                orbit.meanMotion = 0.1f + 2.0f * unit(random);
+                batch.add(orbit);
+            }
+            vector<float> x(batch.paddedSize()), y(batch.paddedSize()), z(batch.paddedSize());
+
+            // repeat until the run is long enough to time, best of three
+            double propagateMs = 1e30;
+            float time = 12.345f;
+            for(int run = 0; run < 3; run++)
+            {
+                unsigned int repeats = 0;
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                double elapsed;
+                do
+                {
+                    batch.propagate(time, x.data(), y.data(), z.data());
+                    repeats++;
+                    elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                } while(elapsed < 50.0);
+                propagateMs = min(propagateMs, elapsed / repeats);
+            }
+
+            double maxError = 0.0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for(unsigned int i = 0; i < batch.size(); i++)
+            {
+                glm::dvec3 expected = batch.reference(i, time);
+                double error = glm::length(expected - glm::dvec3(x[i], y[i], z[i])) / batch.elements(i).semiMajorAxis;
+                maxError = max(maxError, error);
+            }
+            double referenceMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+            ok = ok && maxError <= MAX_ERROR;
+            log << setw(10) << SIZES[s] << setw(22) << (unsigned long long)(SIZES[s] / propagateMs) << setw(22)
+                << (unsigned long long)(SIZES[s] / referenceMs) << setw(10) << setprecision(3) << referenceMs / propagateMs
+                << setw(16) << maxError << endl;
+        }
+        log << "  accuracy " << (ok ? "OK" : "FAILED") << " (bound: error <= " << MAX_ERROR << " a)" << endl;
+        return ok;
+    }
+
+private:
+    unsigned int count;
+    vector<KeplerElements> orbits;
+    // structure-of-arrays, paddedSize() long
+    vector<float> axisPX, axisPY, axisPZ, axisQX, axisQY, axisQZ;
+    vector<float> eccentricity, meanAnomaly, meanMotion;
+
+    void resizeArrays(unsigned int size)
+    {
+        vector<float> *arrays[] = { &axisPX, &axisPY, &axisPZ, &axisQX, &axisQY, &axisQZ, &eccentricity, &meanAnomaly, &meanMotion };
+        for(int i = 0; i < 9; i++)
+            arrays[i]->resize(size, 0.0f);
+    }
+
+    static const char *simdName()
+    {
+#ifdef __AVX2__
+        return "AVX2";
+#else
+        return "SSE2";
+#endif
+    }
+
+    // parent frame with z north -> scene frame with y up
+    static glm::dvec3 sceneFrame(const glm::dvec3 &v)
+    {
+        return glm::dvec3(v.x, v.z, -v.y);
+    }
+
+    // sin and cos of every lane: reduced to r = x - q pi/2 in -pi/4..pi/4 (pi/2 in three parts, as in Cephes),
+    // both polynomials evaluated, then swapped and negated by the quadrant q
+    static void sinCos(KeplerLanes::Float x, KeplerLanes::Float &sine, KeplerLanes::Float &cosine)
+    {
+        typedef KeplerLanes L;
+        L::Int q = L::round(L::mul(x, L::set(0.63661977f)));
+        L::Float quadrant = L::toFloat(q);
+        L::Float r = L::sub(x, L::mul(quadrant, L::set(1.5703125f)));
+        r = L::sub(r, L::mul(quadrant, L::set(4.837512969970703125e-4f)));
+        r = L::sub(r, L::mul(quadrant, L::set(7.54978995489188216e-8f)));
+        L::Float r2 = L::mul(r, r);
+
+        L::Float s = L::mulAdd(r2, L::set(-1.9515295891e-4f), L::set(8.3321608736e-3f));
+        s = L::mulAdd(r2, s, L::set(-1.6666654611e-1f));
+        s = L::mulAdd(L::mul(r2, r), s, r);
+        L::Float c = L::mulAdd(r2, L::set(2.443315711809948e-5f), L::set(-1.388731625493765e-3f));
+        c = L::mulAdd(r2, c, L::set(4.166664568298827e-2f));
+        c = L::mulAdd(L::mul(r2, r2), c, L::sub(L::set(1.0f), L::mul(r2, L::set(0.5f))));
+
+        // odd quadrants swap sin and cos; sin is negative in quadrants 2 and 3, cos in 1 and 2
+        L::Float swap = L::bits(L::equalInt(L::andInt(q, L::setInt(1)), L::setInt(1)));
+        L::Float sineSign = L::bits(L::shiftLeft30(L::andInt(q, L::setInt(2))));
+        L::Float cosineSign = L::bits(L::shiftLeft30(L::andInt(L::addInt(q, L::setInt(1)), L::setInt(2))));
+        sine = L::bitXor(L::select(swap, c, s), sineSign);
+        cosine = L::bitXor(L::select(swap, s, c), cosineSign);
+    }
+
+    KeplerOrbits(const KeplerOrbits&);
+    KeplerOrbits& operator=(const KeplerOrbits&);
+};
+#endif
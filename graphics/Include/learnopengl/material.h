@@ -0,0 +1,111 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Texture {
+    unsigned int id;
+    string type;
+    string path;
+};
+
+// what a texture is used for; Texture::type holds the matching sampler prefix ("texture_diffuse", ...)
+enum TextureSlot {
+    TEXTURE_DIFFUSE,
+    TEXTURE_SPECULAR,
+    TEXTURE_NORMAL,
+    TEXTURE_HEIGHT,
+    TEXTURE_OTHER
+};
+
+inline TextureSlot TextureSlotFromType(const string &type)
+{
+    if(type == "texture_diffuse")
+        return TEXTURE_DIFFUSE;
+    if(type == "texture_specular")
+        return TEXTURE_SPECULAR;
+    if(type == "texture_normal")
+        return TEXTURE_NORMAL;
+    if(type == "texture_height")
+        return TEXTURE_HEIGHT;
+    return TEXTURE_OTHER;
+}
+
+// The textures of a mesh, bound the way Mesh::Draw always did it: texture i goes to unit i and the sampler
+// named after its type and number within that type (texture_diffuse1, texture_diffuse2, texture_specular1, ...)
+// is pointed at that unit. Sampler names are built once when the material is created and looked up once per
+// program, so bind() makes no allocations and no string operations after a program's first draw.
+class Material
+{
+public:
+    // texture units in use at most; further textures are ignored
+    static const unsigned int MAX_TEXTURES = 16;
+
+    Material() : textureCount(0)
+    {
+    }
+
+    Material(const vector<Texture> &textures) : textureCount(0)
+    {
+        unsigned int numbers[TEXTURE_OTHER + 1] = { 0 };
+        for(unsigned int i = 0; i < textures.size() && textureCount < MAX_TEXTURES; i++)
+        {
+            TextureSlot slot = TextureSlotFromType(textures[i].type);
+            ids[textureCount] = textures[i].id;
+            slots[textureCount] = slot;
+            // unknown types keep their bare name as the sampler name
+            samplerNames.push_back(slot == TEXTURE_OTHER ? textures[i].type : textures[i].type + std::to_string(++numbers[slot]));
+            textureCount++;
+        }
+    }
+
+    // binds the textures and points the program's samplers at them; 'shader' must be in use
+    void bind(Shader &shader)
+    {
+        const int *handles = samplers(shader);
+        for(unsigned int i = 0; i < textureCount; i++)
+        {
+            shader.setInt(handles[i], (int)i);
+            GLState::get().bindTexture(i, GL_TEXTURE_2D, ids[i]); // skipped when the unit already has it
+        }
+    }
+
+    unsigned int size() const { return textureCount; }
+    // groups draws that bind the same textures when sorted on it (see RenderQueue)
+    unsigned int sortKey() const { return textureCount ? ids[0] : 0; }
+    TextureSlot slot(unsigned int i) const { return slots[i]; }
+
+private:
+    // sampler handles of one program, see Shader::uniform
+    struct ProgramSamplers {
+        unsigned int program;
+        int handles[MAX_TEXTURES];
+    };
+
+    unsigned int ids[MAX_TEXTURES];
+    TextureSlot slots[MAX_TEXTURES];
+    unsigned int textureCount;
+    vector<string> samplerNames;
+    vector<ProgramSamplers> programs;	// one entry per program the material was drawn with
+
+    const int *samplers(Shader &shader)
+    {
+        for(unsigned int i = 0; i < programs.size(); i++)
+            if(programs[i].program == shader.ID)
+                return programs[i].handles;
+        ProgramSamplers entry;
+        entry.program = shader.ID;
+        for(unsigned int i = 0; i < textureCount; i++)
+            entry.handles[i] = shader.uniform(samplerNames[i]);
+        programs.push_back(entry);
+        return programs.back().handles;
+    }
+};
+#endif
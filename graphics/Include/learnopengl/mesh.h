@@ -5,7 +5,10 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <learnopengl/gl_state.h>
+#include <learnopengl/material.h>
 #include <learnopengl/shader.h>
 
 #include <string>
@@ -28,10 +31,63 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
-struct Texture {
-    unsigned int id;
-    string type;
-    string path;
+// compact vertex layout used by packed meshes (20 bytes instead of the 56 of Vertex)
+struct PackedVertex {
+    // position, 16 bit normalized within the mesh bounding box (w unused)
+    unsigned short Position[4];
+    // normal, GL_INT_2_10_10_10_REV
+    unsigned int Normal;
+    // tangent, GL_INT_2_10_10_10_REV; w holds the sign of the bitangent, which is cross(Normal, Tangent) * w
+    unsigned int Tangent;
+    // texCoords, 16 bit normalized when all of the mesh's coordinates are within [0, 1], half floats otherwise
+    unsigned short TexCoords[2];
+};
+
+// per instance data of Mesh::DrawInstanced(), vertex attributes 5 and 6 (see asteroid.vs): the instance's
+// position and uniform scale, and its rotation as a unit quaternion (x, y, z, w)
+struct MeshInstance {
+    glm::vec4 positionScale;
+    glm::vec4 rotation;
+};
+
+// one level of detail: a range of the mesh's index buffer and how far (object space) it deviates from LOD 0
+struct MeshLod {
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    float error;
+};
+
+// imported mesh data that has not been uploaded yet. The arrays are either owned (fresh import) or
+// point into memory owned by someone else (e.g. a mapped mesh cache); vertexData/indexData always
+// point at whichever of the two holds the data. Moving keeps them valid (the vectors hand over their storage);
+// a copy would leave them pointing at the source's arrays, so it is not copyable.
+// Meshes already quantized for Model::packVertices have packedData instead of vertexData (see Mesh::packVertices).
+struct MeshData {
+    MeshData() : vertexData(NULL), vertexCount(0), indexData(NULL), indexCount(0), packedData(NULL), positionOffset(0.0f),
+                 positionScale(1.0f), unitTexCoords(false), bounds(0.0f), boxMin(0.0f), boxMax(0.0f)
+    {
+    }
+    MeshData(MeshData&&) = default;
+    MeshData& operator=(MeshData&&) = default;
+
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures;
+    const Vertex *vertexData;
+    unsigned int vertexCount;
+    const unsigned int *indexData;
+    unsigned int indexCount;
+    vector<PackedVertex> packedVertices;
+    const PackedVertex *packedData;
+    glm::vec3 positionOffset, positionScale;    // dequantization of packedData
+    bool unitTexCoords;                         // packedData's texture coordinates are 16 bit normalized
+    vector<MeshLod> lods;   // index ranges of the levels of detail (all of them when indexCount covers several)
+    glm::vec4 bounds;       // bounding sphere: center, radius
+    glm::vec3 boxMin, boxMax;   // axis aligned bounding box
+
+private:
+    MeshData(const MeshData&);
+    MeshData& operator=(const MeshData&);
 };
 
 class Mesh {
@@ -40,81 +96,234 @@ public:
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
+    Material material;          // binds 'textures', built from them once
+    unsigned int indexCount;
     unsigned int VAO;
+    // packed meshes store PackedVertex; shaders rebuild the position as positionOffset + aPos * positionScale
+    bool packed;
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    unsigned int vertexBytes;   // size of the vertex buffer
+    // levels of detail, finest first; Draw() renders lods[lod] (or all indices when there are none)
+    vector<MeshLod> lods;
+    unsigned int lod;
+    glm::vec4 bounds;           // bounding sphere in object space: center, radius
+    glm::vec3 boxMin, boxMax;   // axis aligned bounding box in object space
 
     /*  Functions  */
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor. Pass the arrays in with std::move to avoid copying them. They are freed as soon as they are in
+    // the GL buffers, unless keepCpuData is set (e.g. for picking or physics), in which case they stay in
+    // 'vertices' and 'indices'.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool packed = false, bool keepCpuData = false)
+        : textures(std::move(textures)), material(this->textures), packed(packed), lod(0), bounds(0.0f), boxMin(0.0f), boxMax(0.0f),
+          instanceBuffer(0), instanceOffset(0)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(vertices.data(), (unsigned int)vertices.size(), indices.data(), (unsigned int)indices.size());
+        if(keepCpuData)
+        {
+            this->vertices.swap(vertices);
+            this->indices.swap(indices);
+        }
+    }
+
+    // constructor, uploads vertex and index data that lives elsewhere (e.g. a mapped mesh cache) straight to the
+    // GL buffers without keeping a CPU copy.
+    Mesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount, vector<Texture> textures,
+         bool packed = false) : textures(std::move(textures)), material(this->textures), packed(packed), lod(0), bounds(0.0f),
+          boxMin(0.0f), boxMax(0.0f), instanceBuffer(0), instanceOffset(0)
+    {
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
+    }
+
+    // constructor for vertices quantized ahead of time by packVertices() (e.g. baked into a mesh cache), uploaded
+    // as they are
+    Mesh(const PackedVertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount, vector<Texture> textures,
+         const glm::vec3 &positionOffset, const glm::vec3 &positionScale, bool unitTexCoords)
+        : textures(std::move(textures)), material(this->textures), packed(true), positionOffset(positionOffset), positionScale(positionScale),
+          lod(0), bounds(0.0f), boxMin(0.0f), boxMax(0.0f), instanceBuffer(0), instanceOffset(0)
+    {
+        setupPackedMesh(vertexData, vertexCount, unitTexCoords, indexData, indexCount);
     }
 
     // render the mesh
-    void Draw(Shader shader) 
-    {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
+    void Draw(Shader &shader) 
+    {
+        bind(shader);
+        if(lods.empty())
+            glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+        else
+            glDrawElements(GL_TRIANGLES, lods[lod].indexCount, GL_UNSIGNED_INT, (void*)(lods[lod].indexOffset * sizeof(unsigned int)));
+    }
+
+    // renders 'instanceCount' copies of the mesh in one draw call, placed by the MeshInstance records of the
+    // buffer given to setInstanceBuffer() starting at 'firstInstance'; all of them use the current level of detail
+    void DrawInstanced(Shader &shader, unsigned int instanceCount, unsigned int firstInstance = 0)
+    {
+        // GL 3.3 has no base instance, the attributes are pointed at the first record instead
+        if(firstInstance != instanceOffset)
+            setInstanceBuffer(instanceBuffer, firstInstance);
+        bind(shader);
+        if(lods.empty())
+            glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
+        else
+            glDrawElementsInstanced(GL_TRIANGLES, lods[lod].indexCount, GL_UNSIGNED_INT, (void*)(lods[lod].indexOffset * sizeof(unsigned int)),
+                                    instanceCount);
+    }
+
+    // sources the per instance attributes 5 and 6 from 'buffer', an array of MeshInstance, starting at record
+    // 'firstInstance'. Shaders that don't read them are unaffected.
+    void setInstanceBuffer(unsigned int buffer, unsigned int firstInstance = 0)
+    {
+        instanceBuffer = buffer;
+        instanceOffset = firstInstance;
+        size_t first = (size_t)firstInstance * sizeof(MeshInstance);
+        GLState::get().bindVertexArray(VAO);
+        GLState::get().bindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)(first + offsetof(MeshInstance, positionScale)));
+        glVertexAttribDivisor(5, 1);
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)(first + offsetof(MeshInstance, rotation)));
+        glVertexAttribDivisor(6, 1);
+    }
+
+    // picks the coarsest LOD whose error stays within 'maxPixelError' pixels, given how many pixels one object space
+    // unit covers at the mesh's distance. Coarser levels are only taken once their error is below 1/LOD_HYSTERESIS
+    // of the limit, so a mesh near a threshold doesn't switch back and forth every frame.
+    void selectLod(float pixelsPerUnit, float maxPixelError = 1.0f)
+    {
+        const float LOD_HYSTERESIS = 1.5f;
+        unsigned int selected = lod < lods.size() ? lod : 0;
+        while(selected > 0 && lods[selected].error * pixelsPerUnit > maxPixelError)
+            selected--;
+        while(selected + 1 < lods.size() && lods[selected + 1].error * pixelsPerUnit * LOD_HYSTERESIS <= maxPixelError)
+            selected++;
+        lod = selected;
+    }
+
+    // bytes of the CPU copy kept by keepCpuData
+    size_t cpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) + lods.capacity() * sizeof(MeshLod);
+    }
+
+    // bytes of the vertex and index buffers
+    size_t gpuBytes() const
+    {
+        return (size_t)vertexBytes + (size_t)indexCount * sizeof(unsigned int);
+    }
+
+    // quantizes vertices to PackedVertex, positions relative to the box 'offset' + [0, 'scale']; returns whether the
+    // texture coordinates were stored as 16 bit normalized
+    static bool packVertices(const Vertex *vertexData, unsigned int vertexCount, vector<PackedVertex> &packedVertices,
+                             glm::vec3 &offset, glm::vec3 &scale)
+    {
+        glm::vec3 low(0.0f), high(0.0f);
+        bool unitTexCoords = true;
+        for(unsigned int i = 0; i < vertexCount; i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            low = i ? glm::min(low, vertexData[i].Position) : vertexData[i].Position;
+            high = i ? glm::max(high, vertexData[i].Position) : vertexData[i].Position;
+            const glm::vec2 &uv = vertexData[i].TexCoords;
+            unitTexCoords = unitTexCoords && uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        offset = low;
+        scale = glm::max(high - low, glm::vec3(1e-20f));
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        packedVertices.resize(vertexCount);
+        for(unsigned int i = 0; i < vertexCount; i++)
+        {
+            const Vertex &v = vertexData[i];
+            PackedVertex &p = packedVertices[i];
+            glm::vec3 position = glm::clamp((v.Position - offset) / scale, 0.0f, 1.0f) * 65535.0f + 0.5f;
+            p.Position[0] = (unsigned short)position.x;
+            p.Position[1] = (unsigned short)position.y;
+            p.Position[2] = (unsigned short)position.z;
+            p.Position[3] = 0;
+
+            p.Normal = glm::packSnorm3x10_1x2(glm::vec4(safeNormalize(v.Normal), 0.0f));
+            // the bitangent is left handed when it points away from cross(normal, tangent)
+            float sign = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            p.Tangent = glm::packSnorm3x10_1x2(glm::vec4(safeNormalize(v.Tangent), sign));
+
+            if(unitTexCoords)
+            {
+                p.TexCoords[0] = (unsigned short)(v.TexCoords.x * 65535.0f + 0.5f);
+                p.TexCoords[1] = (unsigned short)(v.TexCoords.y * 65535.0f + 0.5f);
+            }
+            else
+            {
+                p.TexCoords[0] = glm::packHalf1x16(v.TexCoords.x);
+                p.TexCoords[1] = glm::packHalf1x16(v.TexCoords.y);
+            }
+        }
+        return unitTexCoords;
+    }
+
+    // triangles the next Draw() renders
+    unsigned int triangleCount() const
+    {
+        return (lods.empty() ? indexCount : lods[lod].indexCount) / 3;
     }
 
 private:
     /*  Render data  */
     unsigned int VBO, EBO;
+    unsigned int instanceBuffer, instanceOffset;    // where the instance attributes currently point
+    // handles of the dequantization uniforms in each program the mesh was drawn with, see Shader::uniform
+    struct ProgramHandles {
+        unsigned int program;
+        int positionOffset, positionScale;
+    };
+    vector<ProgramHandles> programs;
 
     /*  Functions    */
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // binds the textures, position dequantization and vertex array for a draw
+    void bind(Shader &shader)
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        material.bind(shader);
+
+        // position dequantization (identity for float vertices)
+        const ProgramHandles &handles = programHandles(shader);
+        shader.setVec3(handles.positionOffset, positionOffset);
+        shader.setVec3(handles.positionScale, positionScale);
 
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        // the VAO stays bound (see GLState), drawing the same mesh again doesn't rebind it
+        GLState::get().bindVertexArray(VAO);
+    }
+
+    const ProgramHandles &programHandles(Shader &shader)
+    {
+        for(unsigned int i = 0; i < programs.size(); i++)
+            if(programs[i].program == shader.ID)
+                return programs[i];
+        ProgramHandles entry;
+        entry.program = shader.ID;
+        entry.positionOffset = shader.uniform("positionOffset");
+        entry.positionScale = shader.uniform("positionScale");
+        programs.push_back(entry);
+        return programs.back();
+    }
+
+    // initializes all the buffer objects/arrays
+    void setupMesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount)
+    {
+        if(packed)
+        {
+            vector<PackedVertex> packedVertices;
+            bool unitTexCoords = packVertices(vertexData, vertexCount, packedVertices, positionOffset, positionScale);
+            setupPackedMesh(packedVertices.data(), vertexCount, unitTexCoords, indexData, indexCount);
+            return;
+        }
+        positionOffset = glm::vec3(0.0f);
+        positionScale = glm::vec3(1.0f);
+        createBuffers();
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        vertexBytes = vertexCount * sizeof(Vertex);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -132,8 +341,59 @@ private:
         // vertex bitangent
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        uploadIndices(indexData, indexCount);
+    }
+
+    // the same for PackedVertex, dequantized by positionOffset/positionScale (set by the caller)
+    void setupPackedMesh(const PackedVertex *vertexData, unsigned int vertexCount, bool unitTexCoords, const unsigned int *indexData,
+                         unsigned int indexCount)
+    {
+        createBuffers();
+        vertexBytes = vertexCount * sizeof(PackedVertex);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
 
-        glBindVertexArray(0);
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        if(unitTexCoords)
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        else
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        // vertex tangent and bitangent sign
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+        uploadIndices(indexData, indexCount);
+    }
+
+    // creates the vertex array and buffers and leaves the vertex array and vertex buffer bound
+    void createBuffers()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        GLState::get().bindVertexArray(VAO);
+        GLState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
+    }
+
+    void uploadIndices(const unsigned int *indexData, unsigned int indexCount)
+    {
+        this->indexCount = indexCount;
+        GLState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+
+        GLState::get().bindVertexArray(0);
+    }
+
+    static glm::vec3 safeNormalize(const glm::vec3 &v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : glm::vec3(0.0f);
     }
 };
 #endif
@@ -0,0 +1,413 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+// MappedFile below uses CreateFileA/CreateFileMappingA/MapViewOfFile
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <vector>
+using namespace std;
+
+// Baked mesh cache
+// ----------------
+// One binary file per source asset and vertex layout ("<asset>.meshcache" for Vertex, "<asset>.packed.meshcache"
+// for PackedVertex, next to the asset) holding the final vertex/index arrays exactly as they are uploaded to the
+// GL buffers; packed meshes keep their dequantization in the entry. The file is memory mapped on load so the data
+// goes from the page cache straight into glBufferData, with no Assimp parse and no per-vertex copying.
+//
+// Layout (all offsets from the start of the file, vertex and index blocks 16 byte aligned):
+//   MeshCacheHeader
+//   source path (pathLength bytes, not terminated)
+//   MeshCacheEntry[meshCount]
+//   per mesh: texture records, vertex block, index block (every LOD back to back), MeshLod[lodCount]
+//
+// The cache is keyed on source path + modification time + size + Assimp import flags, and is discarded as soon
+// as any of those, the format version or the vertex layout change.
+
+const unsigned int MESH_CACHE_MAGIC   = 0x4853454D; // "MESH"
+// 2: meshes are welded and reordered by MeshOptimizer, 3: LODs, 4: boxes, 5: PackedVertex layout
+const unsigned int MESH_CACHE_VERSION = 5;
+
+struct MeshCacheHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int importFlags;
+    unsigned int vertexSize;        // sizeof(Vertex) or sizeof(PackedVertex) at bake time
+    unsigned int packed;            // the vertices are PackedVertex
+    unsigned long long sourceTime;  // st_mtime of the source asset
+    unsigned long long sourceSize;
+    unsigned int meshCount;
+    unsigned int pathLength;
+};
+
+struct MeshCacheEntry {
+    unsigned long long vertexOffset;
+    unsigned long long indexOffset;
+    unsigned long long textureOffset;
+    unsigned long long lodOffset;
+    unsigned int vertexCount;
+    unsigned int indexCount;        // all levels of detail
+    unsigned int textureCount;
+    unsigned int lodCount;
+    float bounds[4];                // bounding sphere: center, radius
+    float box[6];                   // axis aligned bounding box: min, max
+    float positionOffset[3];        // dequantization of packed vertices (see Mesh::packVertices)
+    float positionScale[3];
+    unsigned int unitTexCoords;     // packed texture coordinates are 16 bit normalized, half floats otherwise
+};
+
+// texture record: MeshCacheTexture followed by typeLength + pathLength characters
+struct MeshCacheTexture {
+    unsigned int typeLength;
+    unsigned int pathLength;
+};
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() : data(NULL), size(0)
+    {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#endif
+    }
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(string const &path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if(file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping)
+            data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!data)
+        {
+            close();
+            return false;
+        }
+        size = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps its own reference to the file
+        if(view == MAP_FAILED)
+            return false;
+        data = (const unsigned char*)view;
+        size = (size_t)st.st_size;
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if(data)
+            UnmapViewOfFile(data);
+        if(mapping)
+            CloseHandle(mapping);
+        if(file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#else
+        if(data)
+            munmap((void*)data, size);
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+    const unsigned char *data;
+    size_t size;
+
+private:
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    // a mapping owns OS handles, so it is not copyable
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+class MeshCache
+{
+public:
+    // location of the baked file for a source asset in either vertex layout
+    static string cachePath(string const &sourcePath, bool packed)
+    {
+        return sourcePath + (packed ? ".packed.meshcache" : ".meshcache");
+    }
+
+    // fills the modification time and size of a source asset, returns false if it doesn't exist
+    static bool sourceStamp(string const &sourcePath, unsigned long long &time, unsigned long long &size)
+    {
+        struct stat st;
+        if(stat(sourcePath.c_str(), &st) != 0)
+            return false;
+        time = (unsigned long long)st.st_mtime;
+        size = (unsigned long long)st.st_size;
+        return true;
+    }
+
+    // maps the cache of a source asset and validates it against the source, the import flags and the vertex layout.
+    // on success the entries and textures can be read through mesh()/texture() while 'file' stays open; 'packed'
+    // caches are read with packedVertices(), the others with vertices().
+    static bool open(MappedFile &file, string const &sourcePath, unsigned int importFlags, bool packed)
+    {
+        unsigned long long time, size;
+        if(!sourceStamp(sourcePath, time, size))
+            return false;
+        if(!file.open(cachePath(sourcePath, packed)))
+            return false;
+        if(file.size < sizeof(MeshCacheHeader))
+            return reject(file);
+
+        const MeshCacheHeader *header = (const MeshCacheHeader*)file.data;
+        if(header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION ||
+           header->importFlags != importFlags || header->packed != (packed ? 1u : 0u) ||
+           header->vertexSize != (packed ? sizeof(PackedVertex) : sizeof(Vertex)) ||
+           header->sourceTime != time || header->sourceSize != size ||
+           header->pathLength != sourcePath.size())
+            return reject(file);
+        size_t tableOffset = align(sizeof(MeshCacheHeader) + header->pathLength, 8);
+        if(tableOffset + header->meshCount * sizeof(MeshCacheEntry) > file.size ||
+           memcmp(file.data + sizeof(MeshCacheHeader), sourcePath.data(), header->pathLength) != 0)
+            return reject(file);
+
+        // bounds check every block once so the loader can trust the offsets
+        for(unsigned int i = 0; i < header->meshCount; i++)
+        {
+            const MeshCacheEntry &entry = mesh(file, i);
+            if(entry.vertexOffset + (unsigned long long)entry.vertexCount * header->vertexSize > file.size ||
+               entry.indexOffset + (unsigned long long)entry.indexCount * sizeof(unsigned int) > file.size ||
+               entry.lodOffset + (unsigned long long)entry.lodCount * sizeof(MeshLod) > file.size)
+                return reject(file);
+            for(unsigned int j = 0; j < entry.lodCount; j++)
+            {
+                const MeshLod &lod = lods(file, entry)[j];
+                if((unsigned long long)lod.indexOffset + lod.indexCount > entry.indexCount)
+                    return reject(file);
+            }
+            unsigned long long offset = entry.textureOffset;
+            for(unsigned int j = 0; j < entry.textureCount; j++)
+            {
+                if(offset + sizeof(MeshCacheTexture) > file.size)
+                    return reject(file);
+                const MeshCacheTexture *record = (const MeshCacheTexture*)(file.data + offset);
+                offset += sizeof(MeshCacheTexture) + record->typeLength + record->pathLength;
+                if(offset > file.size)
+                    return reject(file);
+            }
+        }
+        return true;
+    }
+
+    static unsigned int meshCount(const MappedFile &file)
+    {
+        return ((const MeshCacheHeader*)file.data)->meshCount;
+    }
+
+    static const MeshCacheEntry &mesh(const MappedFile &file, unsigned int i)
+    {
+        const MeshCacheHeader *header = (const MeshCacheHeader*)file.data;
+        size_t tableOffset = align(sizeof(MeshCacheHeader) + header->pathLength, 8);
+        return ((const MeshCacheEntry*)(file.data + tableOffset))[i];
+    }
+
+    static const Vertex *vertices(const MappedFile &file, const MeshCacheEntry &entry)
+    {
+        return (const Vertex*)(file.data + entry.vertexOffset);
+    }
+
+    static const PackedVertex *packedVertices(const MappedFile &file, const MeshCacheEntry &entry)
+    {
+        return (const PackedVertex*)(file.data + entry.vertexOffset);
+    }
+
+    static const unsigned int *indices(const MappedFile &file, const MeshCacheEntry &entry)
+    {
+        return (const unsigned int*)(file.data + entry.indexOffset);
+    }
+
+    static const MeshLod *lods(const MappedFile &file, const MeshCacheEntry &entry)
+    {
+        return (const MeshLod*)(file.data + entry.lodOffset);
+    }
+
+    // reads the (type, path) pairs of the textures used by a mesh
+    static void textures(const MappedFile &file, const MeshCacheEntry &entry, vector<Texture> &textures)
+    {
+        size_t offset = (size_t)entry.textureOffset;
+        for(unsigned int i = 0; i < entry.textureCount; i++)
+        {
+            const MeshCacheTexture *record = (const MeshCacheTexture*)(file.data + offset);
+            const char *chars = (const char*)(record + 1);
+            Texture texture;
+            texture.id = 0;
+            texture.type.assign(chars, record->typeLength);
+            texture.path.assign(chars + record->typeLength, record->pathLength);
+            textures.push_back(texture);
+            offset += sizeof(MeshCacheTexture) + record->typeLength + record->pathLength;
+        }
+    }
+
+    // bakes the mesh data of a freshly imported asset, its packedVertices when 'packed' and its vertices otherwise.
+    // The file is written under a temporary name and renamed into place, so a crashed or concurrent write never
+    // leaves a half written cache behind.
+    static bool write(string const &sourcePath, unsigned int importFlags, const vector<MeshData> &meshes, bool packed)
+    {
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        if(!sourceStamp(sourcePath, header.sourceTime, header.sourceSize))
+            return false;
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.importFlags = importFlags;
+        header.packed = packed ? 1 : 0;
+        header.vertexSize = packed ? sizeof(PackedVertex) : sizeof(Vertex);
+        header.meshCount = (unsigned int)meshes.size();
+        header.pathLength = (unsigned int)sourcePath.size();
+
+        // lay out the file
+        vector<MeshCacheEntry> entries(meshes.size());
+        size_t offset = align(sizeof(MeshCacheHeader) + header.pathLength, 8) + entries.size() * sizeof(MeshCacheEntry);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            const MeshData &mesh = meshes[i];
+            MeshCacheEntry &entry = entries[i];
+            memset(&entry, 0, sizeof(entry));
+            entry.textureOffset = offset;
+            entry.textureCount = (unsigned int)mesh.textures.size();
+            for(unsigned int j = 0; j < mesh.textures.size(); j++)
+                offset += sizeof(MeshCacheTexture) + mesh.textures[j].type.size() + mesh.textures[j].path.size();
+            offset = align(offset, 16);
+            entry.vertexOffset = offset;
+            entry.vertexCount = (unsigned int)(packed ? mesh.packedVertices.size() : mesh.vertices.size());
+            offset = align(offset + entry.vertexCount * header.vertexSize, 16);
+            entry.indexOffset = offset;
+            entry.indexCount = (unsigned int)mesh.indices.size();
+            offset = align(offset + mesh.indices.size() * sizeof(unsigned int), 8);
+            entry.lodOffset = offset;
+            entry.lodCount = (unsigned int)mesh.lods.size();
+            offset += mesh.lods.size() * sizeof(MeshLod);
+            for(int j = 0; j < 4; j++)
+                entry.bounds[j] = mesh.bounds[j];
+            for(int j = 0; j < 3; j++)
+            {
+                entry.box[j] = mesh.boxMin[j];
+                entry.box[3 + j] = mesh.boxMax[j];
+                entry.positionOffset[j] = mesh.positionOffset[j];
+                entry.positionScale[j] = mesh.positionScale[j];
+            }
+            entry.unitTexCoords = mesh.unitTexCoords ? 1 : 0;
+        }
+
+        string tempPath = cachePath(sourcePath, packed) + ".tmp";
+        ofstream out(tempPath.c_str(), ios::binary | ios::trunc);
+        if(!out)
+            return false;
+        size_t written = 0;
+        put(out, written, &header, sizeof(header));
+        put(out, written, sourcePath.data(), sourcePath.size());
+        pad(out, written, 8);
+        put(out, written, entries.data(), entries.size() * sizeof(MeshCacheEntry));
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            const MeshData &mesh = meshes[i];
+            for(unsigned int j = 0; j < mesh.textures.size(); j++)
+            {
+                MeshCacheTexture record;
+                record.typeLength = (unsigned int)mesh.textures[j].type.size();
+                record.pathLength = (unsigned int)mesh.textures[j].path.size();
+                put(out, written, &record, sizeof(record));
+                put(out, written, mesh.textures[j].type.data(), record.typeLength);
+                put(out, written, mesh.textures[j].path.data(), record.pathLength);
+            }
+            pad(out, written, 16);
+            if(packed)
+                put(out, written, mesh.packedVertices.data(), mesh.packedVertices.size() * sizeof(PackedVertex));
+            else
+                put(out, written, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            pad(out, written, 16);
+            put(out, written, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+            pad(out, written, 8);
+            put(out, written, mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+        }
+        out.close();
+        if(!out)
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        std::remove(cachePath(sourcePath, packed).c_str());
+        return std::rename(tempPath.c_str(), cachePath(sourcePath, packed).c_str()) == 0;
+    }
+
+private:
+    static size_t align(size_t offset, size_t alignment)
+    {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    static bool reject(MappedFile &file)
+    {
+        file.close();
+        return false;
+    }
+
+    static void put(ofstream &out, size_t &written, const void *data, size_t size)
+    {
+        if(size)
+            out.write((const char*)data, size);
+        written += size;
+    }
+
+    static void pad(ofstream &out, size_t &written, size_t alignment)
+    {
+        static const char zeros[16] = { 0 };
+        put(out, written, zeros, align(written, alignment) - written);
+    }
+};
+#endif
@@ -0,0 +1,373 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <learnopengl/mesh.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// vertex and triangle counts plus post-transform cache statistics of a mesh before and after optimize()
+struct MeshOptimizerStats {
+    unsigned int triangleCount;
+    unsigned int vertexCountBefore, vertexCountAfter;
+    float acmrBefore, acmrAfter;    // average cache miss ratio: vertex shader runs per triangle (0.5 is ideal)
+    float atvrBefore, atvrAfter;    // average transformed vertex ratio: vertex shader runs per vertex (1.0 is ideal)
+};
+
+// Import-time mesh optimization
+// -----------------------------
+// Reorders indexed triangle lists for the GPU, in the order optimize() applies them:
+//   1. weld: vertices with identical position, normal and texture coordinates (and tangent frames within ~2.5
+//      degrees) are merged. Assimp emits one vertex per face corner for OBJ files, so this is what makes the
+//      post-transform cache useful at all.
+//   2. cache: triangles are reordered for the post-transform vertex cache with Forsyth's linear-speed algorithm.
+//   3. overdraw: the cache order is cut into clusters whose local miss ratio stays within 5% of the whole mesh,
+//      and clusters are sorted outside-in, so convex parts occlude the rest of the mesh early (Sander et al.).
+//   4. fetch: vertices are renumbered in order of first use so vertex fetch reads memory sequentially.
+// Statistics are measured with a 16 entry FIFO cache.
+class MeshOptimizer
+{
+public:
+    static const unsigned int STATS_CACHE_SIZE = 16;
+
+    static void optimize(vector<Vertex> &vertices, vector<unsigned int> &indices, MeshOptimizerStats &stats)
+    {
+        stats.triangleCount = (unsigned int)(indices.size() / 3);
+        stats.vertexCountBefore = (unsigned int)vertices.size();
+        stats.acmrBefore = acmr(indices, (unsigned int)vertices.size());
+        stats.atvrBefore = atvr(indices, (unsigned int)vertices.size());
+
+        weld(vertices, indices);
+        reorderForCache(indices, (unsigned int)vertices.size());
+        reorderForOverdraw(indices, vertices, 1.05f);
+        reorderForFetch(vertices, indices);
+
+        stats.vertexCountAfter = (unsigned int)vertices.size();
+        stats.acmrAfter = acmr(indices, (unsigned int)vertices.size());
+        stats.atvrAfter = atvr(indices, (unsigned int)vertices.size());
+    }
+
+    // merges duplicate vertices and rewrites the indices to match
+    static void weld(vector<Vertex> &vertices, vector<unsigned int> &indices)
+    {
+        unordered_multimap<size_t, unsigned int> lookup;
+        lookup.reserve(vertices.size());
+        vector<unsigned int> remap(vertices.size());
+        vector<Vertex> welded;
+        welded.reserve(vertices.size());
+        for(unsigned int i = 0; i < vertices.size(); i++)
+        {
+            const Vertex &v = vertices[i];
+            size_t hash = hashBytes(&v.Position, sizeof(v.Position)) ^ (hashBytes(&v.Normal, sizeof(v.Normal)) * 31) ^
+                          (hashBytes(&v.TexCoords, sizeof(v.TexCoords)) * 131);
+            unsigned int target = (unsigned int)welded.size();
+            pair<unordered_multimap<size_t, unsigned int>::iterator, unordered_multimap<size_t, unsigned int>::iterator> range = lookup.equal_range(hash);
+            for(unordered_multimap<size_t, unsigned int>::iterator it = range.first; it != range.second; ++it)
+            {
+                if(sameVertex(welded[it->second], v))
+                {
+                    target = it->second;
+                    break;
+                }
+            }
+            if(target == welded.size())
+            {
+                lookup.insert(make_pair(hash, target));
+                welded.push_back(v);
+            }
+            remap[i] = target;
+        }
+        for(unsigned int i = 0; i < indices.size(); i++)
+            indices[i] = remap[indices[i]];
+        vertices.swap(welded);
+    }
+
+    // Forsyth's vertex cache optimization: greedily emits the triangle with the best score, where vertices score
+    // higher the more recently they were used and the fewer triangles they have left
+    static void reorderForCache(vector<unsigned int> &indices, unsigned int vertexCount)
+    {
+        const int cacheSize = 32;
+        unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+        if(triangleCount == 0)
+            return;
+
+        // triangles using each vertex; the first 'remaining[v]' entries are the ones not emitted yet
+        vector<unsigned int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+        for(unsigned int i = 0; i < indices.size(); i++)
+            remaining[indices[i]]++;
+        for(unsigned int v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + remaining[v];
+        vector<unsigned int> adjacency(indices.size()), fill(offsets.begin(), offsets.end() - 1);
+        for(unsigned int i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+
+        vector<int> cachePosition(vertexCount, -1);
+        vector<float> vertexScores(vertexCount);
+        for(unsigned int v = 0; v < vertexCount; v++)
+            vertexScores[v] = vertexScore(-1, remaining[v], cacheSize);
+        vector<bool> emitted(triangleCount, false);
+
+        vector<unsigned int> result, cache, nextCache;
+        result.reserve(indices.size());
+        int best = 0;
+        float bestScore = -1.0f;
+        for(unsigned int t = 0; t < triangleCount; t++)
+        {
+            float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+            if(score > bestScore)
+            {
+                bestScore = score;
+                best = (int)t;
+            }
+        }
+        unsigned int scan = 0;
+        while(result.size() < indices.size())
+        {
+            if(best < 0)
+            {
+                // nothing in the cache touches a remaining triangle, continue with the next one in input order
+                while(emitted[scan])
+                    scan++;
+                best = (int)scan;
+            }
+            emitted[best] = true;
+            const unsigned int *triangle = &indices[best * 3];
+            for(int k = 0; k < 3; k++)
+            {
+                unsigned int v = triangle[k];
+                result.push_back(v);
+                unsigned int *begin = &adjacency[offsets[v]], *end = begin + remaining[v];
+                *find(begin, end, (unsigned int)best) = *(end - 1);
+                remaining[v]--;
+            }
+
+            // the triangle's vertices move to the front of the LRU cache
+            nextCache.assign(triangle, triangle + 3);
+            for(unsigned int i = 0; i < cache.size(); i++)
+                if(cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+                    nextCache.push_back(cache[i]);
+            for(unsigned int i = 0; i < nextCache.size(); i++)
+            {
+                unsigned int v = nextCache[i];
+                cachePosition[v] = i < (unsigned int)cacheSize ? (int)i : -1;
+                vertexScores[v] = vertexScore(cachePosition[v], remaining[v], cacheSize);
+            }
+            best = -1;
+            bestScore = -1.0f;
+            for(unsigned int i = 0; i < nextCache.size(); i++)
+            {
+                unsigned int v = nextCache[i];
+                for(unsigned int j = 0; j < remaining[v]; j++)
+                {
+                    unsigned int t = adjacency[offsets[v] + j];
+                    float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                    if(score > bestScore)
+                    {
+                        bestScore = score;
+                        best = (int)t;
+                    }
+                }
+            }
+            if(nextCache.size() > (unsigned int)cacheSize)
+                nextCache.resize(cacheSize);
+            cache.swap(nextCache);
+        }
+        indices.swap(result);
+    }
+
+    // splits the (cache optimized) triangle order into clusters and sorts them so triangles on the outside of
+    // the mesh facing away from its center come first. 'threshold' bounds how much ACMR may be given up.
+    static void reorderForOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices, float threshold)
+    {
+        unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+        if(triangleCount < 2)
+            return;
+        float meshACMR = acmr(indices, (unsigned int)vertices.size());
+
+        // cluster boundaries: hard ones where the cache is cold anyway (all three vertices miss), soft ones as
+        // soon as the cluster's own miss ratio is within 'threshold' of the whole mesh
+        vector<unsigned int> clusters(1, 0);
+        vector<unsigned int> stamps(vertices.size(), 0);
+        unsigned int time = STATS_CACHE_SIZE + 1, misses = 0, clusterStart = 0;
+        for(unsigned int t = 0; t < triangleCount; t++)
+        {
+            unsigned int triangleMisses = 0;
+            for(int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[t * 3 + k];
+                if(time - stamps[v] > STATS_CACHE_SIZE)
+                {
+                    stamps[v] = time++;
+                    triangleMisses++;
+                }
+            }
+            if(triangleMisses == 3 && t > clusterStart)
+            {
+                clusters.push_back(t);
+                clusterStart = t;
+                misses = 0;
+            }
+            misses += triangleMisses;
+            if(t + 1 < triangleCount && (float)misses / (t + 1 - clusterStart) <= threshold * meshACMR)
+            {
+                // start the next cluster with a cold cache, it may end up anywhere in the sorted order
+                clusters.push_back(t + 1);
+                clusterStart = t + 1;
+                misses = 0;
+                time += STATS_CACHE_SIZE + 1;
+            }
+        }
+
+        // sort key: distance of the cluster's centroid from the mesh centroid along the cluster's normal
+        struct Cluster {
+            unsigned int start, end;
+            glm::vec3 centroid, normal;
+            float key;
+        };
+        vector<Cluster> sorted(clusters.size());
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for(unsigned int c = 0; c < clusters.size(); c++)
+        {
+            Cluster &cluster = sorted[c];
+            cluster.start = clusters[c];
+            cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            cluster.centroid = cluster.normal = glm::vec3(0.0f);
+            float area = 0.0f;
+            for(unsigned int t = cluster.start; t < cluster.end; t++)
+            {
+                const glm::vec3 &a = vertices[indices[t * 3]].Position, &b = vertices[indices[t * 3 + 1]].Position,
+                                &d = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 n = glm::cross(b - a, d - a);
+                float triangleArea = glm::length(n);
+                cluster.centroid += (a + b + d) * (triangleArea / 3.0f);
+                cluster.normal += n;
+                area += triangleArea;
+            }
+            meshCentroid += cluster.centroid;
+            meshArea += area;
+            cluster.centroid = area > 0.0f ? cluster.centroid / area : vertices[indices[cluster.start * 3]].Position;
+            float normalLength = glm::length(cluster.normal);
+            cluster.normal = normalLength > 0.0f ? cluster.normal / normalLength : glm::vec3(0.0f);
+        }
+        if(meshArea > 0.0f)
+            meshCentroid /= meshArea;
+        for(unsigned int c = 0; c < sorted.size(); c++)
+            sorted[c].key = glm::dot(sorted[c].centroid - meshCentroid, sorted[c].normal);
+        stable_sort(sorted.begin(), sorted.end(), [](const Cluster &a, const Cluster &b) { return a.key > b.key; });
+
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        for(unsigned int c = 0; c < sorted.size(); c++)
+            result.insert(result.end(), indices.begin() + sorted[c].start * 3, indices.begin() + sorted[c].end * 3);
+        indices.swap(result);
+    }
+
+    // renumbers vertices in order of first use and drops unreferenced ones
+    static void reorderForFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+    {
+        const unsigned int unused = 0xFFFFFFFF;
+        vector<unsigned int> remap(vertices.size(), unused);
+        vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for(unsigned int i = 0; i < indices.size(); i++)
+        {
+            unsigned int &target = remap[indices[i]];
+            if(target == unused)
+            {
+                target = (unsigned int)ordered.size();
+                ordered.push_back(vertices[indices[i]]);
+            }
+            indices[i] = target;
+        }
+        vertices.swap(ordered);
+    }
+
+    // vertex shader invocations per triangle with a STATS_CACHE_SIZE entry FIFO cache
+    static float acmr(const vector<unsigned int> &indices, unsigned int vertexCount)
+    {
+        if(indices.size() < 3)
+            return 0.0f;
+        return (float)cacheMisses(indices, vertexCount) / (indices.size() / 3);
+    }
+
+    // vertex shader invocations per referenced vertex with a STATS_CACHE_SIZE entry FIFO cache
+    static float atvr(const vector<unsigned int> &indices, unsigned int vertexCount)
+    {
+        vector<bool> used(vertexCount, false);
+        unsigned int usedCount = 0;
+        for(unsigned int i = 0; i < indices.size(); i++)
+        {
+            if(!used[indices[i]])
+                usedCount++;
+            used[indices[i]] = true;
+        }
+        return usedCount ? (float)cacheMisses(indices, vertexCount) / usedCount : 0.0f;
+    }
+
+private:
+    static unsigned int cacheMisses(const vector<unsigned int> &indices, unsigned int vertexCount)
+    {
+        // a vertex is cached while fewer than STATS_CACHE_SIZE other vertices were loaded after it
+        vector<unsigned int> stamps(vertexCount, 0);
+        unsigned int time = STATS_CACHE_SIZE + 1, misses = 0;
+        for(unsigned int i = 0; i < indices.size(); i++)
+        {
+            if(time - stamps[indices[i]] > STATS_CACHE_SIZE)
+            {
+                stamps[indices[i]] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    static float vertexScore(int cachePosition, unsigned int remaining, int cacheSize)
+    {
+        if(remaining == 0)
+            return -1.0f; // no triangles left, the vertex doesn't matter any more
+        float score = 0.0f;
+        if(cachePosition >= 0)
+        {
+            if(cachePosition < 3)
+                score = 0.75f; // used by the last triangle; a fixed score so strips don't get preferred
+            else
+                score = powf(1.0f - (float)(cachePosition - 3) / (cacheSize - 3), 1.5f);
+        }
+        // boost vertices with few triangles left so they get finished instead of leaving lone triangles behind
+        return score + 2.0f / sqrtf((float)remaining);
+    }
+
+    static bool sameVertex(const Vertex &a, const Vertex &b)
+    {
+        return memcmp(&a.Position, &b.Position, sizeof(a.Position)) == 0 && memcmp(&a.Normal, &b.Normal, sizeof(a.Normal)) == 0 &&
+               memcmp(&a.TexCoords, &b.TexCoords, sizeof(a.TexCoords)) == 0 &&
+               sameDirection(a.Tangent, b.Tangent) && sameDirection(a.Bitangent, b.Bitangent);
+    }
+
+    // true if both vectors are (nearly) parallel, or both are zero
+    static bool sameDirection(const glm::vec3 &a, const glm::vec3 &b)
+    {
+        float la = glm::length(a), lb = glm::length(b);
+        if(la == 0.0f || lb == 0.0f)
+            return la == lb;
+        return glm::dot(a, b) >= 0.999f * la * lb;
+    }
+
+    // FNV-1a
+    static size_t hashBytes(const void *data, size_t size)
+    {
+        const unsigned char *bytes = (const unsigned char*)data;
+        size_t hash = (size_t)2166136261u;
+        for(size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * (size_t)16777619u;
+        return hash;
+    }
+};
+#endif
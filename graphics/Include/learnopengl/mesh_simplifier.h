@@ -0,0 +1,319 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/mesh_optimizer.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Level of detail generation
+// --------------------------
+// Simplifies an indexed mesh with quadric error metrics (Garland & Heckbert). Every LOD reuses the vertices of
+// the full mesh: an edge collapse moves a vertex onto one of its neighbours, so LODs are just shorter index lists
+// appended to the same index buffer. Vertices on open borders or attribute seams (several vertices sharing one
+// position, e.g. the UV seam and the poles of a sphere) are never moved, which keeps seams closed and UVs intact.
+//
+// Collapses are applied in passes: each pass sorts all candidate collapses by error and applies the cheapest ones
+// whose neighbourhoods don't overlap and don't flip a triangle, until the pass' target is reached.
+class MeshSimplifier
+{
+public:
+    // appends up to 'maxLods' - 1 simplified versions of the mesh in 'indices' to 'indices', each with about
+    // 'ratio' times the triangles of the previous one, and describes all levels (LOD 0 is the input) in 'lods'
+    static void buildLods(const vector<Vertex> &vertices, vector<unsigned int> &indices, vector<MeshLod> &lods,
+                          unsigned int maxLods = 4, float ratio = 0.5f, unsigned int minTriangles = 64)
+    {
+        lods.clear();
+        MeshLod base;
+        base.indexOffset = 0;
+        base.indexCount = (unsigned int)indices.size();
+        base.error = 0.0f;
+        lods.push_back(base);
+
+        vector<unsigned int> previous(indices), simplified;
+        while(lods.size() < maxLods && previous.size() / 3 > minTriangles)
+        {
+            float error = 0.0f;
+            unsigned int target = (unsigned int)(previous.size() / 3 * ratio) * 3;
+            simplify(vertices, previous, target, simplified, error);
+            if(simplified.size() > previous.size() * 0.8f)
+                break; // everything left is locked or would cause too much damage
+            MeshOptimizer::reorderForCache(simplified, (unsigned int)vertices.size());
+
+            MeshLod lod;
+            lod.indexOffset = (unsigned int)indices.size();
+            lod.indexCount = (unsigned int)simplified.size();
+            lod.error = max(error, lods.back().error);
+            lods.push_back(lod);
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+            previous.swap(simplified);
+        }
+    }
+
+    // collapses edges of 'indices' until at most 'targetIndexCount' indices are left or nothing more can be
+    // collapsed. 'error' receives the largest distance (object space) a collapse moved the surface by.
+    static void simplify(const vector<Vertex> &vertices, const vector<unsigned int> &indices, unsigned int targetIndexCount,
+                         vector<unsigned int> &result, float &error)
+    {
+        unsigned int vertexCount = (unsigned int)vertices.size();
+        result = indices;
+        error = 0.0f;
+
+        // one representative per distinct position; positions with several vertices are seams
+        vector<unsigned int> positionOf(vertexCount);
+        {
+            unordered_map<size_t, vector<unsigned int> > lookup;
+            for(unsigned int v = 0; v < vertexCount; v++)
+            {
+                const glm::vec3 &p = vertices[v].Position;
+                size_t hash = hashPosition(p);
+                vector<unsigned int> &bucket = lookup[hash];
+                positionOf[v] = v;
+                for(unsigned int i = 0; i < bucket.size(); i++)
+                {
+                    if(memcmp(&vertices[bucket[i]].Position, &p, sizeof(p)) == 0)
+                    {
+                        positionOf[v] = bucket[i];
+                        break;
+                    }
+                }
+                if(positionOf[v] == v)
+                    bucket.push_back(v);
+            }
+        }
+        vector<bool> locked(vertexCount, false);
+        {
+            // seams: more than one referenced vertex at a position
+            vector<unsigned int> firstVertex(vertexCount, 0xFFFFFFFF);
+            for(unsigned int i = 0; i < result.size(); i++)
+            {
+                unsigned int v = result[i], p = positionOf[v];
+                if(firstVertex[p] == 0xFFFFFFFF)
+                    firstVertex[p] = v;
+                else if(firstVertex[p] != v)
+                    locked[p] = true;
+            }
+            // borders: edges (between positions) used by a single triangle
+            unordered_map<unsigned long long, int> edgeUse;
+            for(unsigned int t = 0; t + 2 < result.size(); t += 3)
+            {
+                for(int k = 0; k < 3; k++)
+                {
+                    unsigned int a = positionOf[result[t + k]], b = positionOf[result[t + (k + 1) % 3]];
+                    edgeUse[edgeKey(a, b)]++;
+                }
+            }
+            for(unordered_map<unsigned long long, int>::iterator it = edgeUse.begin(); it != edgeUse.end(); ++it)
+            {
+                if(it->second == 1)
+                {
+                    locked[(unsigned int)(it->first >> 32)] = true;
+                    locked[(unsigned int)(it->first & 0xFFFFFFFF)] = true;
+                }
+            }
+        }
+
+        // plane quadrics of every triangle, area weighted, summed per position
+        vector<Quadric> quadrics(vertexCount);
+        for(unsigned int t = 0; t + 2 < result.size(); t += 3)
+        {
+            const glm::vec3 &a = vertices[result[t]].Position, &b = vertices[result[t + 1]].Position, &c = vertices[result[t + 2]].Position;
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float area = glm::length(n);
+            if(area <= 0.0f)
+                continue;
+            Quadric q(n / area, -glm::dot(n / area, a), area);
+            for(int k = 0; k < 3; k++)
+                quadrics[positionOf[result[t + k]]].add(q);
+        }
+
+        vector<unsigned int> remap(vertexCount), offsets, adjacency;
+        vector<bool> touched(vertexCount);
+        vector<Collapse> collapses;
+        while(result.size() > targetIndexCount)
+        {
+            buildAdjacency(result, vertexCount, offsets, adjacency);
+
+            // candidate collapses: a free vertex onto either end of each of its edges
+            collapses.clear();
+            for(unsigned int t = 0; t + 2 < result.size(); t += 3)
+            {
+                for(int k = 0; k < 3; k++)
+                {
+                    unsigned int u = result[t + k], v = result[t + (k + 1) % 3];
+                    if(!locked[positionOf[u]])
+                        collapses.push_back(Collapse(u, v, collapseCost(quadrics, positionOf, vertices, u, v)));
+                    if(!locked[positionOf[v]])
+                        collapses.push_back(Collapse(v, u, collapseCost(quadrics, positionOf, vertices, v, u)));
+                }
+            }
+            if(collapses.empty())
+                break;
+            sort(collapses.begin(), collapses.end());
+
+            for(unsigned int v = 0; v < vertexCount; v++)
+                remap[v] = v;
+            fill(touched.begin(), touched.end(), false);
+            size_t removed = 0, needed = (result.size() - targetIndexCount) / 3;
+            unsigned int applied = 0;
+            for(unsigned int i = 0; i < collapses.size() && removed < needed; i++)
+            {
+                const Collapse &collapse = collapses[i];
+                unsigned int u = collapse.from, v = collapse.to;
+                if(touched[u] || touched[v] || remap[u] != u || flips(vertices, result, offsets, adjacency, u, v))
+                    continue;
+                // the neighbourhood of u changes shape, leave it alone for the rest of this pass
+                for(unsigned int j = offsets[u]; j < offsets[u + 1]; j++)
+                {
+                    const unsigned int *triangle = &result[adjacency[j] * 3];
+                    touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+                    if(triangle[0] == v || triangle[1] == v || triangle[2] == v)
+                        removed++;
+                }
+                remap[u] = v;
+                quadrics[positionOf[v]].add(quadrics[positionOf[u]]);
+                error = max(error, collapse.cost);
+                applied++;
+            }
+            if(applied == 0)
+                break;
+
+            // apply the pass and drop the triangles that collapsed
+            size_t write = 0;
+            for(unsigned int t = 0; t + 2 < result.size(); t += 3)
+            {
+                unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+                if(a == b || b == c || a == c)
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+    }
+
+    // bounding sphere of a mesh: center of its bounding box, radius to the farthest vertex
+    static glm::vec4 boundingSphere(const vector<Vertex> &vertices)
+    {
+        if(vertices.empty())
+            return glm::vec4(0.0f);
+        glm::vec3 low, high;
+        boundingBox(vertices, low, high);
+        glm::vec3 center = (low + high) * 0.5f;
+        float radius = 0.0f;
+        for(unsigned int i = 0; i < vertices.size(); i++)
+            radius = max(radius, glm::length(vertices[i].Position - center));
+        return glm::vec4(center, radius);
+    }
+
+    // axis aligned box around the vertices (both corners zero when there are none)
+    static void boundingBox(const vector<Vertex> &vertices, glm::vec3 &low, glm::vec3 &high)
+    {
+        low = high = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+        for(unsigned int i = 1; i < vertices.size(); i++)
+        {
+            low = glm::min(low, vertices[i].Position);
+            high = glm::max(high, vertices[i].Position);
+        }
+    }
+
+private:
+    // symmetric 4x4 error quadric of a set of planes, plus the total weight (area) of the planes
+    struct Quadric {
+        float a2, ab, ac, ad, b2, bc, bd, c2, cd, d2, weight;
+        Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0), weight(0) {}
+        Quadric(const glm::vec3 &n, float d, float w)
+            : a2(n.x * n.x * w), ab(n.x * n.y * w), ac(n.x * n.z * w), ad(n.x * d * w), b2(n.y * n.y * w), bc(n.y * n.z * w),
+              bd(n.y * d * w), c2(n.z * n.z * w), cd(n.z * d * w), d2(d * d * w), weight(w) {}
+        void add(const Quadric &q)
+        {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2; bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+            weight += q.weight;
+        }
+        // weighted sum of squared distances of p to the planes
+        float evaluate(const glm::vec3 &p) const
+        {
+            float x = p.x, y = p.y, z = p.z;
+            return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x + b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+                   c2 * z * z + 2 * cd * z + d2;
+        }
+    };
+
+    struct Collapse {
+        unsigned int from, to;
+        float cost;
+        Collapse(unsigned int from, unsigned int to, float cost) : from(from), to(to), cost(cost) {}
+        bool operator<(const Collapse &other) const { return cost < other.cost; }
+    };
+
+    // RMS distance the surface around 'u' and 'v' moves when 'u' is moved onto 'v': the merged vertex is measured
+    // against the planes of both ends, Q_u + Q_v
+    static float collapseCost(const vector<Quadric> &quadrics, const vector<unsigned int> &positionOf,
+                              const vector<Vertex> &vertices, unsigned int u, unsigned int v)
+    {
+        Quadric q = quadrics[positionOf[u]];
+        q.add(quadrics[positionOf[v]]);
+        if(q.weight <= 0.0f)
+            return 0.0f;
+        return sqrtf(max(q.evaluate(vertices[v].Position), 0.0f) / q.weight);
+    }
+
+    // true if moving 'u' onto 'v' turns any remaining triangle around 'u' over
+    static bool flips(const vector<Vertex> &vertices, const vector<unsigned int> &indices, const vector<unsigned int> &offsets,
+                      const vector<unsigned int> &adjacency, unsigned int u, unsigned int v)
+    {
+        const glm::vec3 &target = vertices[v].Position;
+        for(unsigned int j = offsets[u]; j < offsets[u + 1]; j++)
+        {
+            const unsigned int *triangle = &indices[adjacency[j] * 3];
+            if(triangle[0] == v || triangle[1] == v || triangle[2] == v)
+                continue; // collapses away
+            glm::vec3 p[3], q[3];
+            for(int k = 0; k < 3; k++)
+            {
+                p[k] = vertices[triangle[k]].Position;
+                q[k] = triangle[k] == u ? target : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]), after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if(glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+    // triangles around every vertex: adjacency[offsets[v] .. offsets[v + 1]]
+    static void buildAdjacency(const vector<unsigned int> &indices, unsigned int vertexCount, vector<unsigned int> &offsets,
+                               vector<unsigned int> &adjacency)
+    {
+        offsets.assign(vertexCount + 1, 0);
+        for(unsigned int i = 0; i < indices.size(); i++)
+            offsets[indices[i] + 1]++;
+        for(unsigned int v = 0; v < vertexCount; v++)
+            offsets[v + 1] += offsets[v];
+        adjacency.resize(indices.size());
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for(unsigned int i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+    }
+
+    static unsigned long long edgeKey(unsigned int a, unsigned int b)
+    {
+        return a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+    }
+
+    static size_t hashPosition(const glm::vec3 &p)
+    {
+        unsigned int bits[3];
+        memcpy(bits, &p, sizeof(bits));
+        return (size_t)bits[0] * 73856093u ^ (size_t)bits[1] * 19349663u ^ (size_t)bits[2] * 83492791u;
+    }
+};
+#endif
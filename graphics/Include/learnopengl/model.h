@@ -5,6 +5,10 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+// these only need the stb_image declarations, so they come before the implementation
+#include <learnopengl/texture_image.h>
+#include <learnopengl/texture_streamer.h>
+#include <learnopengl/virtual_texture.h>
 #define STB_IMAGE_IMPLEMENTATION    
 #include <stb_image.h>
 #include <assimp/Importer.hpp>
@@ -12,6 +16,9 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimizer.h>
+#include <learnopengl/mesh_simplifier.h>
 #include <learnopengl/shader.h>
 
 #include <string>
@@ -19,10 +26,11 @@
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, bool compress = false);
 
 class Model 
 {
@@ -32,40 +40,273 @@ public:
     vector<Mesh> meshes;
     string directory;
     bool gammaCorrection;
+    TextureStreamer *textureStreamer;	// when set, textures are streamed in the background instead of being decoded up front.
+    bool compressTextures;	// block compress textures (DXT1/DXT5) and cache them next to their source as DDS.
+    bool packVertices;	// upload meshes in the compact PackedVertex layout (shaders must apply positionOffset/positionScale).
+    bool keepCpuData;	// keep the vertex and index arrays in memory after upload (for picking or physics); freed otherwise.
+    glm::vec4 bounds;	// bounding sphere around all meshes (center, radius), set by upload()
+    glm::vec3 boxMin, boxMax;	// axis aligned bounding box around all meshes
 
     /*  Functions   */
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, TextureStreamer *streamer = NULL, bool compress = false)
+        : gammaCorrection(gamma), textureStreamer(streamer), compressTextures(compress), packVertices(false), keepCpuData(false),
+          bounds(0.0f), boxMin(0.0f), boxMax(0.0f)
     {
         loadModel(path);
     }
 
+    // constructs an empty model that is filled in two steps by import() and upload() (see ModelLoader)
+    Model() : gammaCorrection(false), textureStreamer(NULL), compressTextures(false), packVertices(false), keepCpuData(false),
+              bounds(0.0f), boxMin(0.0f), boxMax(0.0f)
+    {
+    }
+
     // draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    void Draw(Shader &shader)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
-    
-private:
-    /*  Functions   */
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+
+    // draws 'instanceCount' copies of every mesh in one call each, see Mesh::DrawInstanced
+    void DrawInstanced(Shader &shader, unsigned int instanceCount, unsigned int firstInstance = 0)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, instanceCount, firstInstance);
+    }
+
+    // per instance data for DrawInstanced(), an array of MeshInstance shared by all meshes
+    void setInstanceBuffer(unsigned int buffer)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].setInstanceBuffer(buffer);
+    }
+
+    // chooses the level of detail of every mesh from the radius its bounding sphere projects to on screen
+    // ('viewportHeight' pixels high) when drawn with these matrices
+    void selectLod(const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection, float viewportHeight, float maxPixelError = 1.0f)
+    {
+        glm::mat4 modelView = view * model;
+        float scale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            Mesh &mesh = meshes[i];
+            float distance = glm::length(glm::vec3(modelView * glm::vec4(glm::vec3(mesh.bounds), 1.0f)));
+            float radius = mesh.bounds.w * scale;
+            if(distance <= radius)
+            {
+                mesh.selectLod(1e30f); // the camera is inside the bounds
+                continue;
+            }
+            // pixels per world unit at the sphere's distance; the projected radius is radius * that
+            float pixelsPerUnit = projection[1][1] * 0.5f * viewportHeight / distance;
+            mesh.selectLod(pixelsPerUnit * scale, maxPixelError);
+        }
+    }
+
+    // triangles the next Draw() renders, with the currently selected levels of detail
+    unsigned int triangleCount() const
+    {
+        unsigned int count = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            count += meshes[i].triangleCount();
+        return count;
+    }
+
+    // resident memory of the model: CPU copies kept by keepCpuData, and the GL buffers and textures (GL thread only)
+    void memoryReport(ostream &out)
     {
+        size_t cpuBytes = 0, bufferBytes = 0, textureBytes = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            cpuBytes += meshes[i].cpuBytes();
+            bufferBytes += meshes[i].gpuBytes();
+        }
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            textureBytes += TextureMemory(textures_loaded[i].id);
+        out << "Model: " << directory << ": " << meshes.size() << " meshes, CPU " << cpuBytes / 1024 << " KB, GPU buffers "
+            << bufferBytes / 1024 << " KB, GPU textures " << textureBytes / 1024 << " KB" << endl;
+    }
+
+    // CPU half of loading: imports the meshes (or maps their baked cache) and lists the textures they use.
+    // Makes no GL calls, so it can run on any thread; decodeImage() and upload() finish the job.
+    bool import(string const &path)
+    {
+        const unsigned int importFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // packed meshes are baked packed, so a warm start uploads them as they are mapped; a CPU copy (keepCpuData)
+        // needs the float vertices, which the other cache holds
+        bool packed = packVertices && !keepCpuData;
+
+        // a valid baked cache skips ASSIMP entirely
+        if(importCachedModel(path, importFlags, packed))
+            return true;
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, importFlags);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        if(packed)
+        {
+            for(unsigned int i = 0; i < pendingMeshes.size(); i++)
+            {
+                MeshData &data = pendingMeshes[i];
+                data.unitTexCoords = Mesh::packVertices(data.vertexData, data.vertexCount, data.packedVertices, data.positionOffset,
+                                                        data.positionScale);
+                data.packedData = data.packedVertices.data();
+                vector<Vertex>().swap(data.vertices);
+                data.vertexData = NULL;
+            }
+        }
+
+        // bake the result so the next start can skip the import
+        if(!MeshCache::write(path, importFlags, pendingMeshes, packed))
+            cout << "WARNING::MESH_CACHE:: could not write " << MeshCache::cachePath(path, packed) << endl;
+        return true;
+    }
+
+    // number of images import() found that still have to be decoded
+    unsigned int pendingImageCount() const
+    {
+        return (unsigned int)pendingImages.size();
+    }
+
+    // decodes one of the pending images. Makes no GL calls; different images may be decoded concurrently.
+    // streamed models leave decoding to the TextureStreamer.
+    void decodeImage(unsigned int i)
+    {
+        if(textureStreamer)
+            return;
+        LoadTextureImage(pendingImages[i].path.c_str(), directory, pendingImages[i], compressTextures);
+    }
+
+    // GL half of loading: creates the textures and vertex buffers for everything import() produced.
+    // Must run on the thread that owns the GL context.
+    void upload()
+    {
+        for(unsigned int i = 0; i < pendingImages.size(); i++)
+        {
+            unsigned int id;
+            if(textureStreamer)
+                id = textureStreamer->request(pendingImages[i].path.c_str(), directory, compressTextures);
+            else
+                id = TextureFromImage(pendingImages[i], gammaCorrection);
+            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+                if(textures_loaded[j].path == pendingImages[i].path)
+                    textures_loaded[j].id = id;
+        }
+        meshes.reserve(meshes.size() + pendingMeshes.size());
+        for(unsigned int i = 0; i < pendingMeshes.size(); i++)
+        {
+            MeshData &data = pendingMeshes[i];
+            for(unsigned int j = 0; j < data.textures.size(); j++)
+                data.textures[j].id = loadedTextureID(data.textures[j].path);
+            if(data.packedData)
+                meshes.push_back(Mesh(data.packedData, data.vertexCount, data.indexData, data.indexCount, std::move(data.textures),
+                                      data.positionOffset, data.positionScale, data.unitTexCoords));
+            else if(!data.vertices.empty())
+                meshes.push_back(Mesh(std::move(data.vertices), std::move(data.indices), std::move(data.textures), packVertices, keepCpuData));
+            else if(keepCpuData) // the cached arrays live in the mapping, which goes away below
+                meshes.push_back(Mesh(vector<Vertex>(data.vertexData, data.vertexData + data.vertexCount),
+                                      vector<unsigned int>(data.indexData, data.indexData + data.indexCount), std::move(data.textures), packVertices, true));
+            else
+                meshes.push_back(Mesh(data.vertexData, data.vertexCount, data.indexData, data.indexCount, std::move(data.textures), packVertices));
+            meshes.back().lods.swap(data.lods);
+            meshes.back().bounds = data.bounds;
+            meshes.back().boxMin = data.boxMin;
+            meshes.back().boxMax = data.boxMax;
+        }
+        updateBounds();
+        pendingMeshes.clear();
+        pendingImages.clear();
+        pendingCache.reset(); // the cached arrays are in the GL buffers now, unmap the file
+    }
+
+private:
+    /*  Import Data  */
+    vector<MeshData> pendingMeshes;
+    vector<TextureImage> pendingImages;
+    shared_ptr<MappedFile> pendingCache;
+
+    /*  Functions   */
+    // model bounds from those of the meshes: the box around their boxes, and the sphere around their spheres
+    // centered on that box
+    void updateBounds()
+    {
+        if(meshes.empty())
+            return;
+        boxMin = meshes[0].boxMin;
+        boxMax = meshes[0].boxMax;
+        for(unsigned int i = 1; i < meshes.size(); i++)
+        {
+            boxMin = glm::min(boxMin, meshes[i].boxMin);
+            boxMax = glm::max(boxMax, meshes[i].boxMax);
+        }
+        glm::vec3 center = (boxMin + boxMax) * 0.5f;
+        float radius = 0.0f;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            radius = max(radius, glm::length(glm::vec3(meshes[i].bounds) - center) + meshes[i].bounds.w);
+        bounds = glm::vec4(center, radius);
+    }
+
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    void loadModel(string const &path)
+    {
+        if(!import(path))
+            return;
+        for(unsigned int i = 0; i < pendingImageCount(); i++)
+            decodeImage(i);
+        upload();
+    }
+
+    // maps the baked cache of a model (of PackedVertex when 'packed'); its meshes will be uploaded directly from the
+    // mapping. returns false when there is no cache or it is stale, in which case the model has to be imported.
+    bool importCachedModel(string const &path, unsigned int importFlags, bool packed)
+    {
+        shared_ptr<MappedFile> file(new MappedFile());
+        if(!MeshCache::open(*file, path, importFlags, packed))
+            return false;
+
+        unsigned int meshCount = MeshCache::meshCount(*file);
+        pendingMeshes.resize(meshCount);
+        for(unsigned int i = 0; i < meshCount; i++)
+        {
+            const MeshCacheEntry &entry = MeshCache::mesh(*file, i);
+            MeshData &data = pendingMeshes[i];
+            MeshCache::textures(*file, entry, data.textures);
+            for(unsigned int j = 0; j < data.textures.size(); j++)
+                data.textures[j] = loadTexture(data.textures[j].path.c_str(), data.textures[j].type);
+            if(packed)
+            {
+                data.packedData = MeshCache::packedVertices(*file, entry);
+                data.positionOffset = glm::vec3(entry.positionOffset[0], entry.positionOffset[1], entry.positionOffset[2]);
+                data.positionScale = glm::vec3(entry.positionScale[0], entry.positionScale[1], entry.positionScale[2]);
+                data.unitTexCoords = entry.unitTexCoords != 0;
+            }
+            else
+                data.vertexData = MeshCache::vertices(*file, entry);
+            data.vertexCount = entry.vertexCount;
+            data.indexData = MeshCache::indices(*file, entry);
+            data.indexCount = entry.indexCount;
+            data.lods.assign(MeshCache::lods(*file, entry), MeshCache::lods(*file, entry) + entry.lodCount);
+            data.bounds = glm::vec4(entry.bounds[0], entry.bounds[1], entry.bounds[2], entry.bounds[3]);
+            data.boxMin = glm::vec3(entry.box[0], entry.box[1], entry.box[2]);
+            data.boxMax = glm::vec3(entry.box[3], entry.box[4], entry.box[5]);
+        }
+        pendingCache = file;
+        return true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -77,7 +318,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            pendingMeshes.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -87,12 +328,13 @@ private:
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vector<Texture> &textures = data.textures;
 
         // Walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -141,6 +383,24 @@ private:
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+        // weld and reorder for the post-transform cache, overdraw and vertex fetch
+        MeshOptimizerStats stats;
+        MeshOptimizer::optimize(vertices, indices, stats);
+        ostringstream report; // one write, so reports of models imported in parallel don't interleave
+        report << "MeshOptimizer: " << directory << "/" << mesh->mName.C_Str() << ": " << stats.triangleCount << " triangles, "
+               << stats.vertexCountBefore << " -> " << stats.vertexCountAfter << " vertices, ACMR " << stats.acmrBefore << " -> "
+               << stats.acmrAfter << ", ATVR " << stats.atvrBefore << " -> " << stats.atvrAfter << "\n";
+
+        // levels of detail, appended to the index buffer
+        data.bounds = MeshSimplifier::boundingSphere(vertices);
+        MeshSimplifier::boundingBox(vertices, data.boxMin, data.boxMax);
+        MeshSimplifier::buildLods(vertices, indices, data.lods);
+        report << "MeshSimplifier: " << directory << "/" << mesh->mName.C_Str() << ": LOD triangles";
+        for(unsigned int i = 0; i < data.lods.size(); i++)
+            report << (i ? " / " : " ") << data.lods[i].indexCount / 3;
+        report << ", error " << data.lods.back().error / max(data.bounds.w, 1e-20f) * 100.0f << "% of the radius\n";
+        cout << report.str();
+
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -163,8 +423,12 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data, it becomes a Mesh once it's uploaded
+        data.vertexData = vertices.data();
+        data.vertexCount = (unsigned int)vertices.size();
+        data.indexData = indices.data();
+        data.indexCount = (unsigned int)indices.size();
+        return data;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -176,69 +440,51 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
-};
-
-
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
-{
-    string filename = string(path);
-    filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    // registers a single texture, unless a texture with the same filepath has already been registered for this model.
+    // the image itself is decoded by decodeImage() and gets its GL id in upload().
+    Texture loadTexture(const char *path, string const &typeName)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // check if texture was loaded before and if so, reuse it: skip loading a new texture
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(std::strcmp(textures_loaded[j].path.data(), path) == 0)
+                return textures_loaded[j]; // a texture with the same filepath has already been loaded (optimization)
+        }
+        // if texture hasn't been loaded already, queue it for loading
+        TextureImage image;
+        image.path = path;
+        image.data = NULL;
+        image.compressedFormat = 0;
+        image.mipCount = 1;
+        pendingImages.push_back(image);
 
-        stbi_image_free(data);
+        Texture texture;
+        texture.id = 0;
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
     }
-    else
+
+    unsigned int loadedTextureID(string const &path) const
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            if(textures_loaded[j].path == path)
+                return textures_loaded[j].id;
+        return 0;
     }
+};
+
 
-    return textureID;
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, bool compress)
+{
+    TextureImage image;
+    LoadTextureImage(path, directory, image, compress);
+    return TextureFromImage(image, gamma);
 }
 #endif
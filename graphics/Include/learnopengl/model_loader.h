@@ -0,0 +1,112 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <learnopengl/model.h>
+#include <learnopengl/thread_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Loads several models at once. The CPU phases (Assimp import or cache mapping, processNode/processMesh and
+// image decoding) of every model run concurrently on a thread pool, one task per model plus one per image.
+// The calling thread, which must own the GL context, uploads each model as soon as its CPU work is done,
+// so startup takes roughly as long as the slowest asset instead of the sum of all of them.
+class ModelLoader
+{
+public:
+    ModelLoader(ThreadPool &pool) : pool(pool)
+    {
+    }
+
+    // queues a model; 'model' must stay alive until load() returns
+    void add(Model &model, string const &path)
+    {
+        Job *job = new Job();
+        job->model = &model;
+        job->path = path;
+        job->imported = false;
+        job->remaining = 0;
+        jobs.push_back(unique_ptr<Job>(job));
+    }
+
+    // imports all queued models and uploads them on the calling thread
+    void load()
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(unsigned int i = 0; i < jobs.size(); i++)
+        {
+            Job *job = jobs[i].get();
+            pool.enqueue([this, job] { importModel(job); });
+        }
+
+        for(unsigned int uploaded = 0; uploaded < jobs.size(); uploaded++)
+        {
+            Job *job;
+            {
+                unique_lock<mutex> lock(readyMutex);
+                readyCondition.wait(lock, [this] { return !ready.empty(); });
+                job = ready.front();
+                ready.pop_front();
+            }
+            if(job->imported)
+                job->model->upload();
+        }
+        jobs.clear();
+
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "ModelLoader: loaded models in " << ms << " ms on " << pool.size() << " threads" << endl;
+    }
+
+private:
+    struct Job {
+        Model *model;
+        string path;
+        bool imported;
+        atomic<unsigned int> remaining; // images still being decoded
+    };
+
+    ThreadPool &pool;
+    vector<unique_ptr<Job> > jobs;
+    deque<Job*> ready;
+    mutex readyMutex;
+    condition_variable readyCondition;
+
+    // worker: import the model, then fan its images out over the pool
+    void importModel(Job *job)
+    {
+        job->imported = job->model->import(job->path);
+        unsigned int images = job->imported ? job->model->pendingImageCount() : 0;
+        if(images == 0)
+        {
+            markReady(job);
+            return;
+        }
+        job->remaining = images;
+        for(unsigned int i = 0; i < images; i++)
+        {
+            pool.enqueue([this, job, i]
+            {
+                job->model->decodeImage(i);
+                if(--job->remaining == 0)
+                    markReady(job);
+            });
+        }
+    }
+
+    void markReady(Job *job)
+    {
+        {
+            lock_guard<mutex> lock(readyMutex);
+            ready.push_back(job);
+        }
+        readyCondition.notify_one();
+    }
+};
+#endif
@@ -0,0 +1,637 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+#include <emmintrin.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/job_system.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Gravitating bodies, Barnes-Hut
+// ------------------------------
+// Bodies attract each other (G = 1) and are attracted by an optional fixed centralMass at the origin. Every step
+// rebuilds an octree over the bodies and sums each body's acceleration over it: a cell of width s whose center of
+// mass is d away is used as a single mass when d > s / theta + delta (delta: its center of mass's offset from the
+// cell's center, so a cell around the body itself is always opened), otherwise its children are visited. Smaller
+// theta is more accurate and slower; 0 degenerates to the direct sum.
+//
+// The tree is built in parallel: bounds and 30 bit Morton codes per body, a counting sort into the 64 cells two
+// levels down, then each of those is sorted and built as a subtree on its own task. Nodes are laid out depth first
+// with the index of the next node that is not a descendant, so the force walk needs no stack. Bodies are copied in
+// Morton order for the walk (neighbours in space are neighbours in memory), and the walk is split over the
+// threads in chunks of that order. The work runs on a JobSystem shared with the rest of the frame.
+//
+// Integration is kick-drift-kick leapfrog, symplectic, so energy doesn't drift over long runs. The state is
+// structure-of-arrays in the order the bodies were added, which stays their identity (the renderer's instances).
+class NBodySimulation
+{
+public:
+    enum { LEAF_SIZE = 8 };
+
+    float theta;        // opening angle, see above
+    float softening;    // added in quadrature to every distance, so close encounters stay finite
+    float centralMass;  // fixed at the origin, 0 for none
+
+    // state, in the order of add()
+    vector<float> x, y, z, vx, vy, vz, mass;
+    // positions before the last step(), to draw the bodies in between steps
+    vector<float> previousX, previousY, previousZ;
+
+    // time spent in the last step(), in milliseconds
+    struct Timings {
+        double build, forces, integrate;
+    };
+
+    // runs the work on the threads of 'jobs'
+    explicit NBodySimulation(JobSystem &jobs)
+        : theta(0.7f), softening(0.05f), centralMass(0.0f), jobs(jobs), accelerationsValid(false)
+    {
+        timings.build = timings.forces = timings.integrate = 0.0;
+    }
+
+    unsigned int add(const glm::vec3 &position, const glm::vec3 &velocity, float bodyMass)
+    {
+        x.push_back(position.x);
+        y.push_back(position.y);
+        z.push_back(position.z);
+        vx.push_back(velocity.x);
+        vy.push_back(velocity.y);
+        vz.push_back(velocity.z);
+        mass.push_back(bodyMass);
+        previousX.push_back(position.x);
+        previousY.push_back(position.y);
+        previousZ.push_back(position.z);
+        accelerationsValid = false;
+        return (unsigned int)x.size() - 1;
+    }
+
+    // adds a body on a circular orbit about the central mass, turning about +y the way glm::rotate does (the other
+    // bodies' pull is left out)
+    unsigned int addOrbiting(const glm::vec3 &position, float bodyMass)
+    {
+        glm::vec3 tangent = glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), position);
+        float radius = glm::length(position), length = glm::length(tangent);
+        glm::vec3 velocity(0.0f);
+        if(length > 0.0f && radius > 0.0f)
+            velocity = tangent / length * sqrt(centralMass / radius);
+        return add(position, velocity, bodyMass);
+    }
+
+    unsigned int size() const { return (unsigned int)x.size(); }
+    unsigned int threadCount() const { return jobs.threadCount(); }
+    unsigned int nodeCount() const { return (unsigned int)nodes.size(); }
+    const Timings &lastTimings() const { return timings; }
+
+    // advances every body by 'dt'
+    void step(float dt)
+    {
+        if(!accelerationsValid)
+            computeAccelerations();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        // kick half a step, drift a whole one
+        float halfStep = dt * 0.5f;
+        parallelFor(size(), 4096, [&](unsigned int first, unsigned int last)
+        {
+            for(unsigned int i = first; i < last; i++)
+            {
+                previousX[i] = x[i];
+                previousY[i] = y[i];
+                previousZ[i] = z[i];
+                vx[i] += ax[i] * halfStep;
+                vy[i] += ay[i] * halfStep;
+                vz[i] += az[i] * halfStep;
+                x[i] += vx[i] * dt;
+                y[i] += vy[i] * dt;
+                z[i] += vz[i] * dt;
+            }
+        });
+        double integrate = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        computeAccelerations();
+        // and kick the other half with the new accelerations
+        start = chrono::steady_clock::now();
+        parallelFor(size(), 4096, [&](unsigned int first, unsigned int last)
+        {
+            for(unsigned int i = first; i < last; i++)
+            {
+                vx[i] += ax[i] * halfStep;
+                vy[i] += ay[i] * halfStep;
+                vz[i] += az[i] * halfStep;
+            }
+        });
+        timings.integrate = integrate + chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // rebuilds the tree and sums the accelerations at the current positions
+    void computeAccelerations()
+    {
+        unsigned int count = size();
+        ax.resize(count);
+        ay.resize(count);
+        az.resize(count);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        buildTree();
+        chrono::steady_clock::time_point built = chrono::steady_clock::now();
+        parallelFor((unsigned int)groups.size(), 32, [&](unsigned int first, unsigned int last)
+        {
+            for(unsigned int g = first; g < last; g++)
+                groupAccelerations(groups[g].first, groups[g].second);
+        });
+        timings.build = chrono::duration<double, milli>(built - start).count();
+        timings.forces = chrono::duration<double, milli>(chrono::steady_clock::now() - built).count();
+        accelerationsValid = true;
+    }
+
+    glm::vec3 acceleration(unsigned int i) const { return glm::vec3(ax[i], ay[i], az[i]); }
+
+    // acceleration of body 'i' summed over every other body, in double precision: what the tree is checked against
+    glm::dvec3 directAcceleration(unsigned int i) const
+    {
+        glm::dvec3 p(x[i], y[i], z[i]), a(0.0);
+        double softening2 = (double)softening * softening;
+        for(unsigned int j = 0; j < size(); j++)
+        {
+            if(j == i)
+                continue;
+            glm::dvec3 d = glm::dvec3(x[j], y[j], z[j]) - p;
+            double r2 = glm::dot(d, d) + softening2;
+            a += d * (mass[j] / (r2 * sqrt(r2)));
+        }
+        double r2 = glm::dot(p, p) + softening2;
+        return a - p * (centralMass / (r2 * sqrt(r2)));
+    }
+
+    // time per step against the number of bodies and of threads (up to 'maxBodies'), and the accuracy of the tree
+    // against the direct sum for a range of theta, on a disk of bodies orbiting a central mass. Fails when the
+    // error at the default theta is above 1%.
+    static bool benchmark(ostream &log, unsigned int maxBodies)
+    {
+        const unsigned int STEPS = 3, SAMPLES = 256;
+        vector<unsigned int> sizes;
+        sizes.push_back(10000);
+        sizes.push_back(100000);
+        if(maxBodies > 100000)
+            sizes.push_back(maxBodies);
+        vector<unsigned int> threads;
+        unsigned int hardware = max(thread::hardware_concurrency(), 1u);
+        for(unsigned int t = 1; t < hardware; t *= 2)
+            threads.push_back(t);
+        threads.push_back(hardware);
+
+        log << "Barnes-Hut N-body, leapfrog, theta 0.7, " << hardware << " hardware threads" << endl;
+        log << "    bodies   threads   build ms   forces ms   step ms   bodies/s   speedup" << endl;
+        bool ok = true;
+        for(unsigned int s = 0; s < sizes.size(); s++)
+        {
+            double singleThread = 0.0;
+            for(unsigned int t = 0; t < threads.size(); t++)
+            {
+                JobSystem jobs(threads[t]);
+                NBodySimulation simulation(jobs);
+                benchmarkDisk(simulation, sizes[s]);
+                simulation.computeAccelerations();
+                double build = 1e30, forces = 1e30, total = 1e30;
+                for(unsigned int i = 0; i < STEPS; i++)
+                {
+                    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                    simulation.step(0.01f);
+                    total = min(total, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+                    build = min(build, simulation.lastTimings().build);
+                    forces = min(forces, simulation.lastTimings().forces);
+                }
+                if(t == 0)
+                    singleThread = total;
+                log << fixed << setprecision(2) << setw(10) << sizes[s] << setw(10) << threads[t] << setw(11) << build << setw(12) << forces
+                    << setw(10) << total << setw(11) << (unsigned long long)(sizes[s] / total * 1000.0) << setw(10) << singleThread / total << endl;
+            }
+        }
+
+        // accuracy: relative error of the summed acceleration, RMS over a sample of bodies
+        unsigned int accuracySize = min(maxBodies, 100000u);
+        log << "accuracy of the bodies' pull on each other against the direct sum, " << accuracySize << " bodies, " << SAMPLES << " sampled" << endl;
+        log << "     theta   RMS error   forces ms" << endl;
+        JobSystem jobs;
+        NBodySimulation simulation(jobs);
+        benchmarkDisk(simulation, accuracySize);
+        // the central mass's pull is exact and would hide the tree's error
+        simulation.centralMass = 0.0f;
+        const float THETAS[] = { 0.3f, 0.5f, 0.7f, 1.0f };
+        for(int t = 0; t < 4; t++)
+        {
+            simulation.theta = THETAS[t];
+            simulation.computeAccelerations();
+            double squares = 0.0;
+            for(unsigned int i = 0; i < SAMPLES; i++)
+            {
+                unsigned int body = (unsigned int)((unsigned long long)i * accuracySize / SAMPLES);
+                glm::dvec3 expected = simulation.directAcceleration(body);
+                glm::dvec3 error = glm::dvec3(simulation.acceleration(body)) - expected;
+                squares += glm::dot(error, error) / max(glm::dot(expected, expected), 1e-30);
+            }
+            double rms = sqrt(squares / SAMPLES);
+            if(THETAS[t] == 0.7f)
+                ok = ok && rms <= 0.01;
+            log << setw(10) << setprecision(2) << THETAS[t] << setw(12) << setprecision(6) << rms << setw(12) << setprecision(2)
+                << simulation.lastTimings().forces << endl;
+        }
+        log << "  accuracy " << (ok ? "OK" : "FAILED") << " (bound: RMS error <= 1% at theta 0.7)" << endl;
+        return ok;
+    }
+
+private:
+    struct Node {
+        glm::vec3 center;       // of mass
+        float mass;
+        float open2;            // used as one mass beyond sqrt(open2): (s / theta + delta)^2
+        unsigned int next;      // next node that is not a descendant; the first child is the node after this one
+        unsigned int first;     // leaves: the bodies first..first+count in Morton order
+        unsigned int count;     // 0 for inner nodes
+    };
+    // the cells two levels down that are sorted and built on their own
+    enum { BUCKETS = 64, MAX_LEVEL = 10 };
+
+    JobSystem &jobs;
+    bool accelerationsValid;
+    Timings timings;
+    vector<float> ax, ay, az;
+    // tree, and the bodies in Morton order (kept to avoid allocating every step)
+    vector<Node> nodes;
+    vector<Node> bucketNodes[BUCKETS];
+    vector<unsigned long long> keys;    // Morton code << 32 | body
+    vector<unsigned int> codes, order, histograms;
+    vector<glm::vec3> lows, highs;      // bounds of each chunk
+    vector<pair<unsigned int, unsigned int> > groups;  // bodies walking the tree together: first, count
+    vector<float> sortedX, sortedY, sortedZ, sortedMass;
+    unsigned int bucketFirst[BUCKETS + 1];
+    glm::vec3 boundsMin;
+    float boundsWidth;
+
+    // calls body(first, last) for chunks of 'grain' items of 0..count on the job system's threads
+    template<class Body> void parallelFor(unsigned int count, unsigned int grain, const Body &body)
+    {
+        jobs.parallelFor(count, grain, body);
+    }
+
+    // spreads the low 10 bits of 'v' to every third bit
+    static unsigned int expandBits(unsigned int v)
+    {
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v << 8)) & 0x0300F00F;
+        v = (v | (v << 4)) & 0x030C30C3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    // corner of the child cell 'octant' (x in bit 2, y in bit 1, z in bit 0, as in the Morton codes)
+    static glm::vec3 childCorner(const glm::vec3 &corner, float half, unsigned int octant)
+    {
+        return corner + half * glm::vec3((float)((octant >> 2) & 1), (float)((octant >> 1) & 1), (float)(octant & 1));
+    }
+
+    void buildTree()
+    {
+        unsigned int count = size();
+        const unsigned int GRAIN = 8192;
+        unsigned int chunks = (count + GRAIN - 1) / GRAIN;
+        codes.resize(count);
+        keys.resize(count);
+        order.resize(count);
+        sortedX.resize(count);
+        sortedY.resize(count);
+        sortedZ.resize(count);
+        sortedMass.resize(count);
+        histograms.assign((size_t)chunks * BUCKETS, 0);
+        lows.resize(chunks);
+        highs.resize(chunks);
+
+        // bounding cube
+        parallelFor(count, GRAIN, [&](unsigned int first, unsigned int last)
+        {
+            glm::vec3 low(1e30f), high(-1e30f);
+            for(unsigned int i = first; i < last; i++)
+            {
+                glm::vec3 p(x[i], y[i], z[i]);
+                low = glm::min(low, p);
+                high = glm::max(high, p);
+            }
+            lows[first / GRAIN] = low;
+            highs[first / GRAIN] = high;
+        });
+        glm::vec3 low(0.0f), high(0.0f);
+        if(count)
+        {
+            low = lows[0];
+            high = highs[0];
+        }
+        for(unsigned int c = 1; c < chunks; c++)
+        {
+            low = glm::min(low, lows[c]);
+            high = glm::max(high, highs[c]);
+        }
+        boundsMin = low;
+        boundsWidth = max(max(high.x - low.x, high.y - low.y), max(high.z - low.z, 1e-6f)) * 1.0001f;
+
+        // Morton codes, counted per chunk into the top level cells
+        float toGrid = 1024.0f / boundsWidth;
+        parallelFor(count, GRAIN, [&](unsigned int first, unsigned int last)
+        {
+            unsigned int *histogram = &histograms[(size_t)(first / GRAIN) * BUCKETS];
+            for(unsigned int i = first; i < last; i++)
+            {
+                unsigned int cx = (unsigned int)min(max((x[i] - boundsMin.x) * toGrid, 0.0f), 1023.0f);
+                unsigned int cy = (unsigned int)min(max((y[i] - boundsMin.y) * toGrid, 0.0f), 1023.0f);
+                unsigned int cz = (unsigned int)min(max((z[i] - boundsMin.z) * toGrid, 0.0f), 1023.0f);
+                codes[i] = (expandBits(cx) << 2) | (expandBits(cy) << 1) | expandBits(cz);
+                histogram[codes[i] >> 24]++;
+            }
+        });
+        // each chunk's histogram becomes its write offsets within the cells
+        unsigned int offset = 0;
+        for(unsigned int b = 0; b < BUCKETS; b++)
+        {
+            bucketFirst[b] = offset;
+            for(unsigned int c = 0; c < chunks; c++)
+            {
+                unsigned int n = histograms[(size_t)c * BUCKETS + b];
+                histograms[(size_t)c * BUCKETS + b] = offset;
+                offset += n;
+            }
+        }
+        bucketFirst[BUCKETS] = offset;
+        parallelFor(count, GRAIN, [&](unsigned int first, unsigned int last)
+        {
+            unsigned int *next = &histograms[(size_t)(first / GRAIN) * BUCKETS];
+            for(unsigned int i = first; i < last; i++)
+                keys[next[codes[i] >> 24]++] = ((unsigned long long)codes[i] << 32) | i;
+        });
+
+        // sort and build each cell
+        parallelFor(BUCKETS, 1, [&](unsigned int firstBucket, unsigned int lastBucket)
+        {
+            for(unsigned int b = firstBucket; b < lastBucket; b++)
+            {
+                unsigned int first = bucketFirst[b], last = bucketFirst[b + 1];
+                bucketNodes[b].clear();
+                if(first == last)
+                    continue;
+                sort(keys.begin() + first, keys.begin() + last);
+                for(unsigned int k = first; k < last; k++)
+                {
+                    unsigned int i = (unsigned int)keys[k];
+                    order[k] = i;
+                    sortedX[k] = x[i];
+                    sortedY[k] = y[i];
+                    sortedZ[k] = z[i];
+                    sortedMass[k] = mass[i];
+                }
+                float quarter = boundsWidth * 0.25f;
+                glm::vec3 corner = childCorner(childCorner(boundsMin, quarter * 2.0f, b >> 3), quarter, b & 7);
+                buildNode(bucketNodes[b], first, last, 2, corner, quarter);
+            }
+        });
+
+        // the two levels above the cells, then the cells' subtrees in depth first order
+        nodes.clear();
+        if(!count)
+            return;
+        unsigned int base[BUCKETS];
+        Node root = aggregate(0, boundsMin, boundsWidth, 0, BUCKETS);
+        nodes.push_back(root);
+        for(unsigned int a = 0; a < 8; a++)
+        {
+            unsigned int size = 0;
+            for(unsigned int b = a * 8; b < a * 8 + 8; b++)
+                size += (unsigned int)bucketNodes[b].size();
+            if(!size)
+                continue;
+            Node child = aggregate((unsigned int)nodes.size(), childCorner(boundsMin, boundsWidth * 0.5f, a), boundsWidth * 0.5f, a * 8, a * 8 + 8);
+            child.next = (unsigned int)nodes.size() + 1 + size;
+            nodes.push_back(child);
+            unsigned int position = (unsigned int)nodes.size();
+            for(unsigned int b = a * 8; b < a * 8 + 8; b++)
+            {
+                base[b] = position;
+                position += (unsigned int)bucketNodes[b].size();
+            }
+            nodes.resize(position);
+        }
+        nodes[0].next = (unsigned int)nodes.size();
+        parallelFor(BUCKETS, 1, [&](unsigned int firstBucket, unsigned int lastBucket)
+        {
+            for(unsigned int b = firstBucket; b < lastBucket; b++)
+            {
+                const vector<Node> &subtree = bucketNodes[b];
+                for(unsigned int n = 0; n < subtree.size(); n++)
+                {
+                    nodes[base[b] + n] = subtree[n];
+                    nodes[base[b] + n].next += base[b];
+                }
+            }
+        });
+        // leaves, in pieces of up to LEAF_SIZE bodies (a leaf at the deepest level can hold more)
+        groups.clear();
+        for(unsigned int n = 0; n < nodes.size(); n++)
+        {
+            for(unsigned int first = nodes[n].first; first < nodes[n].first + nodes[n].count; first += LEAF_SIZE)
+                groups.push_back(make_pair(first, min(nodes[n].first + nodes[n].count - first, (unsigned int)LEAF_SIZE)));
+        }
+    }
+
+    // node over the cells first..last, combined from their subtrees' roots
+    Node aggregate(unsigned int index, const glm::vec3 &corner, float width, unsigned int first, unsigned int last) const
+    {
+        Node node;
+        node.mass = 0.0f;
+        node.center = glm::vec3(0.0f);
+        for(unsigned int b = first; b < last; b++)
+        {
+            if(bucketNodes[b].empty())
+                continue;
+            node.mass += bucketNodes[b][0].mass;
+            node.center += bucketNodes[b][0].center * bucketNodes[b][0].mass;
+        }
+        finish(node, corner, width);
+        node.next = index + 1;
+        node.first = node.count = 0;
+        return node;
+    }
+
+    // center of mass and opening distance from the summed mass and mass weighted positions
+    void finish(Node &node, const glm::vec3 &corner, float width) const
+    {
+        glm::vec3 cellCenter = corner + glm::vec3(width * 0.5f);
+        node.center = node.mass > 0.0f ? node.center / node.mass : cellCenter;
+        float open = (theta > 0.0f ? width / theta : 1e30f) + glm::length(node.center - cellCenter);
+        node.open2 = open * open;
+    }
+
+    // builds the subtree over the Morton ordered bodies first..last in 'out', depth first; returns its root.
+    // 'next' indices are local to 'out'.
+    unsigned int buildNode(vector<Node> &out, unsigned int first, unsigned int last, unsigned int level, const glm::vec3 &corner, float width)
+    {
+        unsigned int index = (unsigned int)out.size();
+        out.push_back(Node());
+        Node node;
+        node.mass = 0.0f;
+        node.center = glm::vec3(0.0f);
+        if(last - first <= LEAF_SIZE || level == MAX_LEVEL)
+        {
+            for(unsigned int k = first; k < last; k++)
+            {
+                node.mass += sortedMass[k];
+                node.center += glm::vec3(sortedX[k], sortedY[k], sortedZ[k]) * sortedMass[k];
+            }
+            node.first = first;
+            node.count = last - first;
+        }
+        else
+        {
+            // the bodies are sorted, so each child's are a run of those with the same octant at this level
+            unsigned int shift = 32 + 27 - 3 * level;
+            float half = width * 0.5f;
+            unsigned int begin = first;
+            for(unsigned int octant = 0; octant < 8 && begin < last; octant++)
+            {
+                unsigned int end = begin;
+                while(end < last && ((keys[end] >> shift) & 7) == octant)
+                    end++;
+                if(end == begin)
+                    continue;
+                unsigned int child = buildNode(out, begin, end, level + 1, childCorner(corner, half, octant), half);
+                node.mass += out[child].mass;
+                node.center += out[child].center * out[child].mass;
+                begin = end;
+            }
+            node.first = node.count = 0;
+        }
+        finish(node, corner, width);
+        node.next = (unsigned int)out.size();
+        out[index] = node;
+        return index;
+    }
+
+    // pull of a mass m at (sx, sy, sz) on 4 bodies: a += d m / (|d|^2 + softening^2)^3/2. rsqrt plus one Newton
+    // step; a body's pull on itself is 0 (d = 0), so it needs no test.
+    static void pull(__m128 sx, __m128 sy, __m128 sz, __m128 m, __m128 softening2, const __m128 *p, __m128 *a)
+    {
+        __m128 dx = _mm_sub_ps(sx, p[0]), dy = _mm_sub_ps(sy, p[1]), dz = _mm_sub_ps(sz, p[2]);
+        __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_add_ps(_mm_mul_ps(dz, dz), softening2));
+        __m128 inverse = _mm_rsqrt_ps(r2);
+        inverse = _mm_mul_ps(inverse, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r2), _mm_mul_ps(inverse, inverse))));
+        __m128 scale = _mm_mul_ps(_mm_mul_ps(inverse, _mm_mul_ps(inverse, inverse)), m);
+        a[0] = _mm_add_ps(a[0], _mm_mul_ps(dx, scale));
+        a[1] = _mm_add_ps(a[1], _mm_mul_ps(dy, scale));
+        a[2] = _mm_add_ps(a[2], _mm_mul_ps(dz, scale));
+    }
+
+    // accelerations of the Morton ordered bodies first..first+count (at most LEAF_SIZE, of one leaf), written at
+    // their original indices. They walk the tree together, 4 to an SSE register: a node is used as one mass when
+    // it is far enough from the box around all of them, so each node is visited once per leaf instead of once per
+    // body.
+    void groupAccelerations(unsigned int first, unsigned int count)
+    {
+        const unsigned int VECTORS = LEAF_SIZE / 4;
+        // unused lanes sit far away, where nothing pulls on them noticeably
+        float position[3][LEAF_SIZE];
+        glm::vec3 low(1e30f), high(-1e30f);
+        for(unsigned int b = 0; b < LEAF_SIZE; b++)
+        {
+            glm::vec3 p(1e18f);
+            if(b < count)
+            {
+                p = glm::vec3(sortedX[first + b], sortedY[first + b], sortedZ[first + b]);
+                low = glm::min(low, p);
+                high = glm::max(high, p);
+            }
+            position[0][b] = p.x;
+            position[1][b] = p.y;
+            position[2][b] = p.z;
+        }
+        __m128 p[VECTORS][3], a[VECTORS][3];
+        for(unsigned int v = 0; v < VECTORS; v++)
+        {
+            for(int c = 0; c < 3; c++)
+            {
+                p[v][c] = _mm_loadu_ps(&position[c][v * 4]);
+                a[v][c] = _mm_setzero_ps();
+            }
+        }
+        __m128 softening2 = _mm_set1_ps(softening * softening);
+        const Node *tree = nodes.data();
+        unsigned int nodeTotal = (unsigned int)nodes.size();
+        for(unsigned int n = 0; n < nodeTotal;)
+        {
+            const Node &node = tree[n];
+            // distance from the box to the center of mass
+            glm::vec3 outside = glm::max(glm::max(low - node.center, node.center - high), glm::vec3(0.0f));
+            if(node.count)
+            {
+                for(unsigned int j = node.first; j < node.first + node.count; j++)
+                {
+                    __m128 sx = _mm_set1_ps(sortedX[j]), sy = _mm_set1_ps(sortedY[j]), sz = _mm_set1_ps(sortedZ[j]);
+                    __m128 m = _mm_set1_ps(sortedMass[j]);
+                    for(unsigned int v = 0; v < VECTORS; v++)
+                        pull(sx, sy, sz, m, softening2, p[v], a[v]);
+                }
+                n = node.next;
+            }
+            else if(glm::dot(outside, outside) > node.open2)
+            {
+                __m128 sx = _mm_set1_ps(node.center.x), sy = _mm_set1_ps(node.center.y), sz = _mm_set1_ps(node.center.z);
+                __m128 m = _mm_set1_ps(node.mass);
+                for(unsigned int v = 0; v < VECTORS; v++)
+                    pull(sx, sy, sz, m, softening2, p[v], a[v]);
+                n = node.next;
+            }
+            else
+                n++;
+        }
+
+        __m128 zero = _mm_setzero_ps();
+        float acceleration[3][LEAF_SIZE];
+        for(unsigned int v = 0; v < VECTORS; v++)
+        {
+            if(centralMass != 0.0f)
+                pull(zero, zero, zero, _mm_set1_ps(centralMass), softening2, p[v], a[v]);
+            for(int c = 0; c < 3; c++)
+                _mm_storeu_ps(&acceleration[c][v * 4], a[v][c]);
+        }
+        for(unsigned int b = 0; b < count; b++)
+        {
+            unsigned int i = order[first + b];
+            ax[i] = acceleration[0][b];
+            ay[i] = acceleration[1][b];
+            az[i] = acceleration[2][b];
+        }
+    }
+
+    // the benchmark's scene: a disk like the asteroid belt's about a central mass, 1% of it in total
+    static void benchmarkDisk(NBodySimulation &simulation, unsigned int count)
+    {
+        mt19937 random(3);
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+        normal_distribution<float> height(0.0f, 0.75f);
+        simulation.centralMass = 370.0f;
+        float bodyMass = simulation.centralMass * 0.01f / count;
+        for(unsigned int i = 0; i < count; i++)
+        {
+            float radius = sqrt(18.0f * 18.0f + unit(random) * (24.0f * 24.0f - 18.0f * 18.0f));
+            float angle = unit(random) * 6.28318530718f;
+            simulation.addOrbiting(glm::vec3(cos(angle) * radius, height(random), sin(angle) * radius), bodyMass);
+        }
+    }
+
+    NBodySimulation(const NBodySimulation&);
+    NBodySimulation& operator=(const NBodySimulation&);
+};
+#endif
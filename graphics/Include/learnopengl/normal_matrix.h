@@ -0,0 +1,41 @@
+#ifndef NORMAL_MATRIX_H
+#define NORMAL_MATRIX_H
+
+#include <emmintrin.h>
+
+#include <glm/glm.hpp>
+
+// cross product of the xyz lanes (w ends up 0 when both w are equal): yzx(a * yzx(b) - yzx(a) * b)
+inline __m128 NormalMatrixCross(__m128 a, __m128 b)
+{
+    __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// the matrix that transforms normals for 'model': the inverse transpose of its upper 3x3, so normals stay
+// perpendicular to the surface under non-uniform scale. For columns a, b, c that is (b x c, c x a, a x b) / det,
+// three SSE cross products instead of the full inverse the shaders used to do per vertex. Zero for a singular
+// matrix.
+inline glm::mat3 NormalMatrix(const glm::mat4 &model)
+{
+    __m128 a = _mm_and_ps(_mm_loadu_ps(&model[0][0]), _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+    __m128 b = _mm_and_ps(_mm_loadu_ps(&model[1][0]), _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+    __m128 c = _mm_and_ps(_mm_loadu_ps(&model[2][0]), _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+    __m128 bc = NormalMatrixCross(b, c), ca = NormalMatrixCross(c, a), ab = NormalMatrixCross(a, b);
+
+    // det = a . (b x c), summed over the lanes
+    __m128 products = _mm_mul_ps(a, bc);
+    __m128 sum = _mm_add_ps(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    float det = _mm_cvtss_f32(sum);
+    __m128 scale = _mm_set1_ps(det != 0.0f ? 1.0f / det : 0.0f);
+
+    float columns[12];
+    _mm_storeu_ps(columns, _mm_mul_ps(bc, scale));
+    _mm_storeu_ps(columns + 4, _mm_mul_ps(ca, scale));
+    _mm_storeu_ps(columns + 8, _mm_mul_ps(ab, scale));
+    return glm::mat3(columns[0], columns[1], columns[2], columns[4], columns[5], columns[6], columns[8], columns[9], columns[10]);
+}
+#endif
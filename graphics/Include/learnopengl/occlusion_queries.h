@@ -0,0 +1,186 @@
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+
+#include <mutex>
+#include <vector>
+using namespace std;
+
+// Hardware occlusion culling. Each frame the bodies that may be hidden are registered with add() while the frame
+// is being queued; issue() then draws their bounding boxes (no color or depth writes) against the depth the
+// occluders left behind, each inside a GL_ANY_SAMPLES_PASSED query, and the bodies themselves are drawn inside
+// glBeginConditionalRender(query, GL_QUERY_NO_WAIT) (see RenderQueue). The GPU skips a draw whose box produced no
+// samples, and draws it anyway if the result isn't in yet, so nothing ever waits on a query.
+//
+// The CPU never learns which draws were skipped in time to matter, but for the statistics the results are read
+// back when a query is reused two frames later, by which time they are (almost always) available.
+//
+// add() makes no GL calls and may be called from any thread (the frame's draws are recorded by jobs); the queries
+// it hands out are generated beforehand on the GL thread by reserve().
+class OcclusionQueries
+{
+public:
+    // what the queries of the last frame whose results came back found
+    struct Stats {
+        unsigned int tested;            // bodies whose box was drawn
+        unsigned int occluded;          // of those, hidden
+        unsigned long long triangles;   // triangles of the hidden bodies, skipped by conditional rendering
+    };
+
+    // 'nearPlane' is the projection's near distance; boxes closer to the camera than that are not tested, since
+    // the clipped box could report a visible body as hidden. GL thread only.
+    OcclusionQueries(float nearPlane) : nearPlane(nearPlane), frame(0)
+    {
+        issued[0] = issued[1] = false;
+        stats.tested = stats.occluded = 0;
+        stats.triangles = 0;
+        // unit cube, drawn scaled onto each box
+        float corners[] = { 0, 0, 0,  1, 0, 0,  1, 1, 0,  0, 1, 0,  0, 0, 1,  1, 0, 1,  1, 1, 1,  0, 1, 1 };
+        unsigned int faces[] = { 0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,
+                                 3, 6, 2, 3, 7, 6,  0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5 };
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        GLState::get().bindVertexArray(VAO);
+        GLState::get().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        GLState::get().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    }
+
+    // starts a frame: collects the results of the queries this frame reuses and forgets their tests
+    void beginFrame()
+    {
+        frame ^= 1;
+        vector<Test> &reused = tests[frame];
+        if(issued[frame])
+        {
+            Stats result = { 0, 0, 0 };
+            for(unsigned int i = 0; i < reused.size(); i++)
+            {
+                unsigned int available = 0, samples = 1;
+                glGetQueryObjectuiv(reused[i].query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if(!available)
+                    continue;
+                glGetQueryObjectuiv(reused[i].query, GL_QUERY_RESULT, &samples);
+                result.tested++;
+                if(!samples)
+                {
+                    result.occluded++;
+                    result.triangles += reused[i].triangles;
+                }
+            }
+            stats = result;
+        }
+        reused.clear();
+        issued[frame] = false;
+    }
+
+    // makes sure this frame can hand out 'count' queries; call after beginFrame(), on the GL thread
+    void reserve(unsigned int count)
+    {
+        vector<unsigned int> &pool = queries[frame];
+        if(pool.size() >= count)
+            return;
+        unsigned int first = (unsigned int)pool.size();
+        pool.resize(count);
+        glGenQueries(count - first, &pool[first]);
+    }
+
+    // registers a body drawn with 'model' whose object space box is boxMin..boxMax, with 'triangles' triangles
+    // (for the statistics). Returns the query to draw it under, or 0 when it has to be drawn unconditionally.
+    unsigned int add(const glm::mat4 &model, const glm::vec3 &boxMin, const glm::vec3 &boxMax, const glm::vec3 &eye, unsigned int triangles)
+    {
+        // world space box around the body, widened by the near distance: with the camera in it, draw the body
+        glm::vec3 center = glm::vec3(model * glm::vec4((boxMin + boxMax) * 0.5f, 1.0f));
+        glm::vec3 extent(nearPlane);
+        for(int column = 0; column < 3; column++)
+            extent += glm::abs(glm::vec3(model[column])) * (boxMax[column] - boxMin[column]) * 0.5f;
+        if(glm::all(glm::lessThanEqual(glm::abs(eye - center), extent)))
+            return 0;
+
+        lock_guard<mutex> lock(addMutex);
+        vector<Test> &current = tests[frame];
+        vector<unsigned int> &pool = queries[frame];
+        if(current.size() == pool.size())
+            return 0; // more bodies than reserve() was told of
+        Test test;
+        test.box = model;
+        test.box[3] = model * glm::vec4(boxMin, 1.0f);
+        for(int column = 0; column < 3; column++)
+            test.box[column] = model[column] * (boxMax[column] - boxMin[column]);
+        test.query = pool[current.size()];
+        test.triangles = triangles;
+        current.push_back(test);
+        return test.query;
+    }
+
+    // draws the boxes added this frame, each in its query. Call after the occluders and before the bodies;
+    // 'boxShader' is occlusion_box.vs/.fs.
+    void issue(Shader &boxShader)
+    {
+        vector<Test> &current = tests[frame];
+        if(current.empty())
+            return;
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        boxShader.use();
+        int boxHandle = boxShader.uniform("model");
+        GLState::get().bindVertexArray(VAO);
+        for(unsigned int i = 0; i < current.size(); i++)
+        {
+            boxShader.setMat4(boxHandle, current[i].box);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, current[i].query);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+        }
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        issued[frame] = true;
+    }
+
+    const Stats &lastStats() const { return stats; }
+
+    // deletes the queries and the box; call while the GL context is still current
+    void release()
+    {
+        for(int i = 0; i < 2; i++)
+        {
+            if(!queries[i].empty())
+                glDeleteQueries((int)queries[i].size(), queries[i].data());
+            queries[i].clear();
+            tests[i].clear();
+        }
+        GLState::get().deleteBuffers(1, &VBO);
+        GLState::get().deleteBuffers(1, &EBO);
+        GLState::get().deleteVertexArrays(1, &VAO);
+    }
+
+private:
+    struct Test {
+        glm::mat4 box;          // maps the unit cube onto the body's box
+        unsigned int query;
+        unsigned int triangles;
+    };
+
+    float nearPlane;
+    unsigned int VAO, VBO, EBO;
+    // two sets of queries used on alternate frames, so a set's results have had a frame to come back
+    unsigned int frame;
+    vector<unsigned int> queries[2];
+    vector<Test> tests[2];
+    bool issued[2];
+    Stats stats;
+    mutex addMutex;
+
+    OcclusionQueries(const OcclusionQueries&);
+    OcclusionQueries& operator=(const OcclusionQueries&);
+};
+#endif
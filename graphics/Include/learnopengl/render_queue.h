@@ -0,0 +1,229 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/frustum_culler.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/model.h>
+#include <learnopengl/normal_matrix.h>
+#include <learnopengl/shader.h>
+
+#include <cstring>
+#include <functional>
+#include <vector>
+using namespace std;
+
+// One thread's draws of a frame, recorded as packets for RenderQueue::execute(). Recording is plain CPU work
+// (no GL calls), so lists can be filled by jobs on other threads while the GL thread only executes them. The
+// arrays keep their capacity, so recording a frame allocates nothing once the first frames have sized them.
+class CommandList
+{
+public:
+    CommandList() : culler(NULL)
+    {
+    }
+
+    // models submitted from now on are tested against this culler's frustum (NULL submits everything)
+    void setCuller(FrustumCuller *frustumCuller)
+    {
+        culler = frustumCuller;
+    }
+
+    // queues one mesh drawn with 'shader' and 'model' as its model matrix; 'depth' is its distance from the camera.
+    // A non-zero 'instanceCount' draws that many instances of it from 'firstInstance' on (see Mesh::DrawInstanced).
+    // A non-zero 'occlusionQuery' draws it only if that query passed (see OcclusionQueries).
+    void submit(Mesh &mesh, Shader &shader, const glm::mat4 &model, float depth, unsigned int pass, unsigned int instanceCount = 0,
+                unsigned int firstInstance = 0, unsigned int occlusionQuery = 0)
+    {
+        submit(mesh, shader, model, NormalMatrix(model), depth, pass, instanceCount, firstInstance, occlusionQuery);
+    }
+
+    // queues every mesh of a model; the depth of each is that of its bounding sphere's center. With a culler, the
+    // model's sphere is tested first and then each mesh's sphere and box; instanced draws are not culled here
+    // (their instances are spread beyond the mesh bounds, see FrustumCuller::cullInstances).
+    void submit(Model &model, Shader &shader, const glm::mat4 &transform, const glm::mat4 &view, unsigned int pass,
+                unsigned int instanceCount = 0, unsigned int firstInstance = 0, unsigned int occlusionQuery = 0)
+    {
+        bool cull = culler && !instanceCount;
+        if(cull && !culler->sphereVisible(glm::vec3(transform * glm::vec4(glm::vec3(model.bounds), 1.0f)),
+                                          model.bounds.w * FrustumCuller::maxScale(transform)))
+        {
+            culler->culledObjects += (unsigned int)model.meshes.size();
+            return;
+        }
+        glm::mat4 modelView = view * transform;
+        glm::mat3 normalMatrix = NormalMatrix(transform); // once for all the meshes
+        for(unsigned int i = 0; i < model.meshes.size(); i++)
+        {
+            Mesh &mesh = model.meshes[i];
+            if(cull && !culler->meshVisible(mesh, transform))
+                continue;
+            float depth = -(modelView * glm::vec4(glm::vec3(mesh.bounds), 1.0f)).z;
+            submit(mesh, shader, transform, normalMatrix, depth, pass, instanceCount, firstInstance, occlusionQuery);
+        }
+    }
+
+    unsigned int size() const { return (unsigned int)packets.size(); }
+    void clear() { packets.clear(); }
+
+private:
+    friend class RenderQueue;
+
+    struct DrawPacket {
+        unsigned long long key;
+        Mesh *mesh;
+        Shader *shader;
+        glm::mat4 model;
+        glm::mat3 normalMatrix;
+        unsigned int pass;
+        unsigned int instanceCount;
+        unsigned int firstInstance;
+        unsigned int occlusionQuery;
+    };
+
+    FrustumCuller *culler;
+    vector<DrawPacket> packets;
+
+    // submit() with the mesh's normal matrix already computed
+    void submit(Mesh &mesh, Shader &shader, const glm::mat4 &model, const glm::mat3 &normalMatrix, float depth, unsigned int pass,
+                unsigned int instanceCount, unsigned int firstInstance, unsigned int occlusionQuery);
+};
+
+// Executes the packets of a frame's command lists together, in the order of a 64 bit sort key:
+//   bits 60-63 pass, 48-59 program, 32-47 material, 0-31 view depth
+// so draws are grouped by pass, then program, then textures, and within a group opaque geometry goes front to
+// back for early depth rejection. Passes run in increasing order; a pass can have a setup function (e.g. to bind
+// a different light) that runs before its first packet. GL thread only.
+class RenderQueue
+{
+public:
+    static const unsigned int MAX_PASSES = 16;
+
+    RenderQueue()
+    {
+    }
+
+    // runs 'setup' before the packets of 'pass' every frame
+    void setPassSetup(unsigned int pass, function<void()> setup)
+    {
+        passSetup[pass % MAX_PASSES] = setup;
+    }
+
+    // sorts and draws the packets of 'lists' (equal keys in the order of the lists, then of submission), then
+    // empties the lists
+    void execute(CommandList *const *lists, unsigned int listCount)
+    {
+        sort(lists, listCount);
+        unsigned int pass = MAX_PASSES;
+        Shader *shader = NULL;
+        int modelHandle = -1, normalMatrixHandle = -1;
+        for(unsigned int i = 0; i < order.size(); i++)
+        {
+            const CommandList::DrawPacket &packet = *order[i].packet;
+            if(packet.pass != pass)
+            {
+                pass = packet.pass;
+                if(passSetup[pass])
+                    passSetup[pass]();
+                shader = NULL; // the setup may have switched programs
+            }
+            if(packet.shader != shader)
+            {
+                shader = packet.shader;
+                shader->use();
+                modelHandle = shader->uniform("model");
+                normalMatrixHandle = shader->uniform("normalMatrix");
+            }
+            shader->setMat4(modelHandle, packet.model);
+            shader->setMat3(normalMatrixHandle, packet.normalMatrix);
+            // without waiting: until the query's result is in, the mesh is drawn
+            if(packet.occlusionQuery)
+                glBeginConditionalRender(packet.occlusionQuery, GL_QUERY_NO_WAIT);
+            if(packet.instanceCount)
+                packet.mesh->DrawInstanced(*shader, packet.instanceCount, packet.firstInstance);
+            else
+                packet.mesh->Draw(*shader);
+            if(packet.occlusionQuery)
+                glEndConditionalRender();
+        }
+        for(unsigned int l = 0; l < listCount; l++)
+            lists[l]->clear();
+    }
+
+    void execute(CommandList &list)
+    {
+        CommandList *lists[] = { &list };
+        execute(lists, 1);
+    }
+
+private:
+    struct SortEntry {
+        unsigned long long key;
+        const CommandList::DrawPacket *packet;
+    };
+
+    vector<SortEntry> order;
+    vector<SortEntry> scratch;
+    function<void()> passSetup[MAX_PASSES];
+
+    // LSD radix sort of the keys, one byte per pass; bytes that are the same in every key are skipped.
+    // Stable, so equal keys keep their submission order.
+    void sort(CommandList *const *lists, unsigned int listCount)
+    {
+        order.clear();
+        for(unsigned int l = 0; l < listCount; l++)
+        {
+            const vector<CommandList::DrawPacket> &packets = lists[l]->packets;
+            for(unsigned int i = 0; i < packets.size(); i++)
+            {
+                SortEntry entry;
+                entry.key = packets[i].key;
+                entry.packet = &packets[i];
+                order.push_back(entry);
+            }
+        }
+        unsigned int count = (unsigned int)order.size();
+        scratch.resize(count);
+        for(unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            unsigned int histogram[256] = { 0 };
+            for(unsigned int i = 0; i < count; i++)
+                histogram[(order[i].key >> shift) & 0xFF]++;
+            if(count == 0 || histogram[(order[0].key >> shift) & 0xFF] == count)
+                continue;
+            unsigned int offset = 0;
+            for(unsigned int b = 0; b < 256; b++)
+            {
+                unsigned int n = histogram[b];
+                histogram[b] = offset;
+                offset += n;
+            }
+            for(unsigned int i = 0; i < count; i++)
+                scratch[histogram[(order[i].key >> shift) & 0xFF]++] = order[i];
+            order.swap(scratch);
+        }
+    }
+};
+
+inline void CommandList::submit(Mesh &mesh, Shader &shader, const glm::mat4 &model, const glm::mat3 &normalMatrix, float depth,
+                                unsigned int pass, unsigned int instanceCount, unsigned int firstInstance, unsigned int occlusionQuery)
+{
+    DrawPacket packet;
+    packet.mesh = &mesh;
+    packet.shader = &shader;
+    packet.model = model;
+    packet.normalMatrix = normalMatrix;
+    packet.pass = pass % RenderQueue::MAX_PASSES;
+    packet.instanceCount = instanceCount;
+    packet.firstInstance = firstInstance;
+    packet.occlusionQuery = occlusionQuery;
+    // non-negative floats order the same as their bit patterns
+    float clamped = depth > 0.0f ? depth : 0.0f;
+    unsigned int depthBits;
+    memcpy(&depthBits, &clamped, sizeof(depthBits));
+    packet.key = ((unsigned long long)packet.pass << 60) | ((unsigned long long)(shader.ID & 0xFFF) << 48) |
+                 ((unsigned long long)(mesh.material.sortKey() & 0xFFFF) << 32) | depthBits;
+    packets.push_back(packet);
+}
+#endif
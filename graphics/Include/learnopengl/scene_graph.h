@@ -0,0 +1,105 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+using namespace std;
+
+// Transform hierarchy stored flat: nodes are indices into parallel arrays, and a node can only be added after its
+// parent, so one pass in index order sees every parent before its children. Each node has a local translation,
+// rotation and scale and a cached world matrix (parent's world * local). Setting a local transform marks the node
+// dirty; update() recomputes the world matrices of dirty nodes and of everything below them and leaves the rest
+// alone, starting at the first dirty node (nothing at all when no node changed).
+class SceneGraph
+{
+public:
+    static const unsigned int NO_PARENT = ~0u;
+
+    SceneGraph() : firstDirty(0), recomputed(0)
+    {
+    }
+
+    // adds a node under 'parent' (NO_PARENT for a root) and returns its index
+    unsigned int add(unsigned int parent, const glm::vec3 &translation = glm::vec3(0.0f), const glm::quat &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                     const glm::vec3 &scale = glm::vec3(1.0f))
+    {
+        unsigned int node = (unsigned int)parents.size();
+        if(parent >= node)
+            parent = NO_PARENT;
+        parents.push_back(parent);
+        translations.push_back(translation);
+        rotations.push_back(rotation);
+        scales.push_back(scale);
+        worlds.push_back(glm::mat4(1.0f));
+        dirty.push_back(1);
+        markDirty(node);
+        return node;
+    }
+
+    void setTranslation(unsigned int node, const glm::vec3 &translation) { translations[node] = translation; markDirty(node); }
+    void setRotation(unsigned int node, const glm::quat &rotation) { rotations[node] = rotation; markDirty(node); }
+    void setScale(unsigned int node, const glm::vec3 &scale) { scales[node] = scale; markDirty(node); }
+
+    const glm::vec3 &translation(unsigned int node) const { return translations[node]; }
+    const glm::quat &rotation(unsigned int node) const { return rotations[node]; }
+    const glm::vec3 &scale(unsigned int node) const { return scales[node]; }
+    unsigned int parent(unsigned int node) const { return parents[node]; }
+
+    // world matrix as of the last update()
+    const glm::mat4 &world(unsigned int node) const { return worlds[node]; }
+
+    // brings the world matrices of changed nodes and their descendants up to date
+    void update()
+    {
+        recomputed = 0;
+        unsigned int count = (unsigned int)parents.size();
+        // 'dirty' doubles as "recomputed this update" for the children that follow
+        for(unsigned int i = firstDirty; i < count; i++)
+        {
+            unsigned int p = parents[i];
+            if(!dirty[i] && (p == NO_PARENT || !dirty[p]))
+                continue;
+            dirty[i] = 1;
+            glm::mat4 local = localMatrix(i);
+            worlds[i] = p == NO_PARENT ? local : worlds[p] * local;
+            recomputed++;
+        }
+        for(unsigned int i = firstDirty; i < count; i++)
+            dirty[i] = 0;
+        firstDirty = count;
+    }
+
+    unsigned int size() const { return (unsigned int)parents.size(); }
+    // world matrices the last update() recomputed
+    unsigned int recomputedNodes() const { return recomputed; }
+
+private:
+    vector<unsigned int> parents;
+    vector<glm::vec3> translations;
+    vector<glm::quat> rotations;
+    vector<glm::vec3> scales;
+    vector<glm::mat4> worlds;
+    vector<unsigned char> dirty;
+    unsigned int firstDirty;    // no node before this one is dirty
+    unsigned int recomputed;
+
+    void markDirty(unsigned int node)
+    {
+        dirty[node] = 1;
+        if(node < firstDirty)
+            firstDirty = node;
+    }
+
+    // translation * rotation * scale, built directly instead of multiplying three matrices
+    glm::mat4 localMatrix(unsigned int node) const
+    {
+        glm::mat3 rotation = glm::mat3_cast(rotations[node]);
+        const glm::vec3 &scale = scales[node];
+        glm::mat4 local(glm::vec4(rotation[0] * scale.x, 0.0f), glm::vec4(rotation[1] * scale.y, 0.0f), glm::vec4(rotation[2] * scale.z, 0.0f),
+                        glm::vec4(translations[node], 1.0f));
+        return local;
+    }
+};
+#endif
@@ -3,6 +3,8 @@
 
 #include <glad/glad.h>
 
+#include <learnopengl/gl_state.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -72,7 +74,7 @@ public:
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        GLState::get().useProgram(ID); 
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
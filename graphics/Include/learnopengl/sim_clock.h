@@ -0,0 +1,52 @@
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+// Fixed timestep simulation clock. Real frame time goes into an accumulator and comes out as whole ticks of
+// 1 / tickRate seconds, so the simulation steps the same way whatever the frame rate is; the time left over is
+// alpha(), how far the display is between the last two simulated states:
+//
+//     for(unsigned int i = clock.advance(frameSeconds); i > 0; i--) { previous = current; step(current, clock.tickSeconds()); }
+//     draw(mix(previous, current, clock.alpha()));
+//
+// A frame that took very long (a breakpoint, a window drag) is cut to maxFrameSeconds, so the simulation doesn't
+// have to catch up for seconds afterwards.
+class SimClock
+{
+public:
+    SimClock(double tickRate = 60.0, double maxFrameSeconds = 0.25)
+        : tickLength(1.0 / tickRate), maxFrame(maxFrameSeconds), accumulator(0.0), tickCount(0)
+    {
+    }
+
+    // adds a frame's real time and returns how many ticks the simulation has to run for it
+    unsigned int advance(double frameSeconds)
+    {
+        if(frameSeconds > maxFrame)
+            frameSeconds = maxFrame;
+        if(frameSeconds > 0.0)
+            accumulator += frameSeconds;
+        unsigned int ticks = 0;
+        while(accumulator >= tickLength)
+        {
+            accumulator -= tickLength;
+            ticks++;
+        }
+        tickCount += ticks;
+        return ticks;
+    }
+
+    void setTickRate(double tickRate) { tickLength = 1.0 / tickRate; }
+
+    double tickSeconds() const { return tickLength; }
+    // fraction of a tick since the last one, for interpolating between the previous and the current state
+    float alpha() const { return (float)(accumulator / tickLength); }
+    // ticks run so far
+    unsigned long long ticks() const { return tickCount; }
+
+private:
+    double tickLength;
+    double maxFrame;
+    double accumulator;
+    unsigned long long tickCount;
+};
+#endif
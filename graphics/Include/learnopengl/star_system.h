@@ -0,0 +1,492 @@
+#ifndef STAR_SYSTEM_H
+#define STAR_SYSTEM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <learnopengl/kepler_orbits.h>
+#include <learnopengl/model.h>
+#include <learnopengl/model_loader.h>
+#include <learnopengl/scene_graph.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// how a body is lit: emissive (the sun's glow), lit by the bright light reserved for the sun's own surface, lit by
+// the normal light, or lit and tested for occlusion by the bodies drawn before it
+enum BodyShading { BODY_EMISSIVE, BODY_SUN_LIT, BODY_LIT, BODY_OCCLUDABLE };
+
+struct Body {
+    string name;
+    unsigned int model;         // index into StarSystem::models, StarSystem::NO_MODEL for a frame without geometry
+    unsigned int orbit;         // index into StarSystem::orbits, StarSystem::NO_ORBIT for a body that stays put
+    unsigned int orbitNode;     // moved along the orbit about the parent body, then to 'position'; the children's frame
+    unsigned int node;          // spins and is scaled
+    glm::vec3 position;         // offset from the point on the orbit (from the parent's frame without one)
+    float spinRate;             // radians turned per radian of the simulated orbit angle
+    BodyShading shading;
+    bool virtualSurface;        // uses the virtual texture when there is one (--virtual-texture)
+};
+
+// A star system described by a text file, one body per line, parents before their children:
+//
+//   # name   parent  model                            properties
+//   body sun system  resources/sun/planet.obj         scale=1.05 shading=sunlit
+//   body earth sun   resources/earth/Model/Globe.obj  a=30 e=0.0167 orbitrate=1 spin=4 scale=0.2 virtual
+//
+// '-' stands for no parent or no model. Properties: position=x,y,z, the Keplerian elements a= (or orbit=),
+// e=, i=, node=, peri= and m0= (angles in degrees), orbitrate= (mean motion), spin=, scale= (one value or
+// x,y,z), shading=emissive|sunlit|lit|occludable and virtual. A body's frame is its parent's, without the
+// parent's spin and scale, moved along its orbit (when a > 0) and then to its position; only the body itself is
+// spun and scaled, so its children's orbits keep their size and orientation. The orbits are propagated together
+// by KeplerOrbits.
+//
+// The file is read in one piece and parsed in place, parents are looked up in a hash map and models are shared
+// by every body with the same path, so loading is linear in the number of bodies (checked by benchmark()).
+class StarSystem
+{
+public:
+    static const unsigned int NO_MODEL = ~0u;
+    static const unsigned int NO_ORBIT = ~0u;
+
+    vector<Body> bodies;
+    vector<string> modelPaths;  // as written in the file
+    vector<Model*> models;      // one per path, filled in by loadModels()
+    KeplerOrbits orbits;        // of the bodies that have one
+
+    // time spent in the last parse(), in milliseconds: reading the text, then creating the nodes and orbits
+    struct Timings {
+        double parse, build;
+    };
+
+    StarSystem()
+    {
+        timings.parse = timings.build = 0.0;
+    }
+
+    ~StarSystem()
+    {
+        for(unsigned int i = 0; i < models.size(); i++)
+            delete models[i];
+    }
+
+    // parses 'path' and adds the bodies' nodes to 'scene'. Returns false (and adds nothing) on an error.
+    bool load(const string &path, SceneGraph &scene)
+    {
+        string text;
+        if(!readFile(path, text))
+        {
+            cout << "ERROR::STAR_SYSTEM:: could not read " << path << endl;
+            return false;
+        }
+        unsigned int firstBody = (unsigned int)bodies.size(), firstModel = (unsigned int)modelPaths.size();
+        if(!parse(path, text, scene))
+            return false;
+        cout << "StarSystem: " << path << ": " << bodies.size() - firstBody << " bodies, " << modelPaths.size() - firstModel
+             << " models, parsed in " << timings.parse << " ms, built in " << timings.build << " ms" << endl;
+        return true;
+    }
+
+    // load() of a description already in memory: 'text' is NUL terminated and modified in place, errors name 'path'
+    bool parse(const string &path, string &text, SceneGraph &scene)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        unsigned int firstModel = (unsigned int)modelPaths.size();
+        vector<Body> parsed;
+        vector<unsigned int> parents;
+        vector<glm::vec3> positions, scales;
+        vector<KeplerElements> elements;
+        unordered_map<string, unsigned int> bodyIndex, modelIndex;
+        vector<string> paths;
+        char *cursor = &text[0];
+        unsigned int lineNumber = 0;
+        while(*cursor)
+        {
+            // one line, terminated in place
+            char *line = cursor;
+            while(*cursor && *cursor != '\n')
+                cursor++;
+            if(*cursor)
+                *cursor++ = 0;
+            lineNumber++;
+            char *comment = strchr(line, '#');
+            if(comment)
+                *comment = 0;
+
+            char *token = nextToken(line);
+            if(!token)
+                continue;
+            char *name = nextToken(line), *parent = nextToken(line), *model = nextToken(line);
+            if(strcmp(token, "body") != 0 || !model)
+                return error(path, lineNumber, "expected 'body <name> <parent> <model> [properties]'");
+            if(bodyIndex.count(name))
+                return error(path, lineNumber, string("body '") + name + "' is defined twice");
+
+            Body body;
+            body.name = name;
+            body.model = NO_MODEL;
+            body.orbit = NO_ORBIT;
+            body.spinRate = 0.0f;
+            body.shading = BODY_LIT;
+            body.virtualSurface = false;
+            unsigned int parentIndex = SceneGraph::NO_PARENT;
+            if(strcmp(parent, "-") != 0)
+            {
+                unordered_map<string, unsigned int>::iterator found = bodyIndex.find(parent);
+                if(found == bodyIndex.end())
+                    return error(path, lineNumber, string("parent '") + parent + "' must be defined before '" + name + "'");
+                parentIndex = found->second;
+            }
+            if(strcmp(model, "-") != 0)
+            {
+                // models of earlier loads (or addModel()) first, then the ones new in this file
+                unordered_map<string, unsigned int>::iterator found = modelIndices.find(model);
+                if(found == modelIndices.end())
+                {
+                    found = modelIndex.find(model);
+                    if(found == modelIndex.end())
+                    {
+                        found = modelIndex.insert(make_pair(string(model), firstModel + (unsigned int)paths.size())).first;
+                        paths.push_back(model);
+                    }
+                }
+                body.model = found->second;
+            }
+
+            glm::vec3 position(0.0f), scale(1.0f);
+            KeplerElements orbit = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+            while(char *property = nextToken(line))
+            {
+                char *value = strchr(property, '=');
+                if(value)
+                    *value++ = 0;
+                bool ok = true;
+                if(!strcmp(property, "position"))
+                    ok = parseVector(value, position);
+                else if(!strcmp(property, "orbit") || !strcmp(property, "a"))
+                    ok = parseFloat(value, orbit.semiMajorAxis);
+                else if(!strcmp(property, "e"))
+                    ok = parseFloat(value, orbit.eccentricity) && orbit.eccentricity >= 0.0f && orbit.eccentricity < 1.0f;
+                else if(!strcmp(property, "i"))
+                    ok = parseAngle(value, orbit.inclination);
+                else if(!strcmp(property, "node"))
+                    ok = parseAngle(value, orbit.ascendingNode);
+                else if(!strcmp(property, "peri"))
+                    ok = parseAngle(value, orbit.periapsis);
+                else if(!strcmp(property, "m0"))
+                    ok = parseAngle(value, orbit.meanAnomaly);
+                else if(!strcmp(property, "orbitrate"))
+                    ok = parseFloat(value, orbit.meanMotion);
+                else if(!strcmp(property, "spin"))
+                    ok = parseFloat(value, body.spinRate);
+                else if(!strcmp(property, "scale"))
+                    ok = parseVector(value, scale);
+                else if(!strcmp(property, "shading"))
+                    ok = parseShading(value, body.shading);
+                else if(!strcmp(property, "virtual"))
+                    body.virtualSurface = true;
+                else
+                    ok = false;
+                if(!ok)
+                    return error(path, lineNumber, string("bad property '") + property + "'");
+            }
+
+            bodyIndex[body.name] = (unsigned int)parsed.size();
+            parsed.push_back(body);
+            parents.push_back(parentIndex);
+            positions.push_back(position);
+            scales.push_back(scale);
+            elements.push_back(orbit);
+        }
+
+        // everything parsed, now build the nodes
+        chrono::steady_clock::time_point parsedTime = chrono::steady_clock::now();
+        const glm::quat NO_ROTATION(1.0f, 0.0f, 0.0f, 0.0f);
+        for(unsigned int i = 0; i < parsed.size(); i++)
+        {
+            Body &body = parsed[i];
+            unsigned int parentNode = SceneGraph::NO_PARENT;
+            if(parents[i] != SceneGraph::NO_PARENT)
+                parentNode = parsed[parents[i]].orbitNode;
+            if(elements[i].semiMajorAxis > 0.0f)
+                body.orbit = orbits.add(elements[i]);
+            body.position = positions[i];
+            body.orbitNode = scene.add(parentNode, body.position);
+            body.node = scene.add(body.orbitNode, glm::vec3(0.0f), NO_ROTATION, scales[i]);
+            bodies.push_back(body);
+        }
+        modelPaths.insert(modelPaths.end(), paths.begin(), paths.end());
+        modelIndices.insert(modelIndex.begin(), modelIndex.end());
+        models.resize(modelPaths.size(), NULL);
+        selectedBody.resize(models.size());
+        selectedSize.resize(models.size());
+        orbitX.resize(orbits.paddedSize());
+        orbitY.resize(orbits.paddedSize());
+        orbitZ.resize(orbits.paddedSize());
+
+        timings.parse = chrono::duration<double, milli>(parsedTime - start).count();
+        timings.build = chrono::duration<double, milli>(chrono::steady_clock::now() - parsedTime).count();
+        return true;
+    }
+
+    const Timings &lastTimings() const { return timings; }
+
+    // body named 'name', or bodies.size() when there is none
+    unsigned int find(const string &name) const
+    {
+        for(unsigned int i = 0; i < bodies.size(); i++)
+            if(bodies[i].name == name)
+                return i;
+        return (unsigned int)bodies.size();
+    }
+
+    // index of the model at 'path' (as in the file), added when no body uses it yet, so geometry drawn outside the
+    // bodies (the asteroid belt's rock) shares the bodies' copy. Call before loadModels().
+    unsigned int addModel(const string &path)
+    {
+        unordered_map<string, unsigned int>::iterator found = modelIndices.find(path);
+        if(found != modelIndices.end())
+            return found->second;
+        modelIndices.insert(make_pair(path, (unsigned int)modelPaths.size()));
+        modelPaths.push_back(path);
+        models.resize(modelPaths.size(), NULL);
+        selectedBody.resize(models.size());
+        selectedSize.resize(models.size());
+        return (unsigned int)modelPaths.size() - 1;
+    }
+
+    // creates the models, lets 'setup' configure each (streaming, compression, ...) and adds them to 'loader';
+    // model paths are relative to 'directory'
+    void loadModels(ModelLoader &loader, const string &directory, function<void(Model&)> setup)
+    {
+        for(unsigned int i = 0; i < models.size(); i++)
+        {
+            if(models[i])
+                continue;
+            models[i] = new Model();
+            setup(*models[i]);
+            loader.add(*models[i], directory + "/" + modelPaths[i]);
+        }
+    }
+
+    // moves the bodies along their orbits and spins them to the simulated orbit angle, which is the orbits' time
+    void animate(SceneGraph &scene, float angle)
+    {
+        const glm::vec3 Y_AXIS(0.0f, 1.0f, 0.0f);
+        orbits.propagate(angle, orbitX.data(), orbitY.data(), orbitZ.data());
+        for(unsigned int i = 0; i < bodies.size(); i++)
+        {
+            const Body &body = bodies[i];
+            if(body.orbit != NO_ORBIT)
+                scene.setTranslation(body.orbitNode, glm::vec3(orbitX[body.orbit], orbitY[body.orbit], orbitZ[body.orbit]) + body.position);
+            if(body.spinRate != 0.0f)
+                scene.setRotation(body.node, glm::angleAxis(angle * body.spinRate, Y_AXIS));
+        }
+    }
+
+    // levels of detail of every model; a model shared by several bodies is chosen for the one that looks largest.
+    // 'extraModel' placed by 'extraWorld' (e.g. the belt's rock, see addModel()) competes with the bodies using it.
+    void selectLods(const SceneGraph &scene, const glm::mat4 &view, const glm::mat4 &projection, float viewportHeight,
+                    unsigned int extraModel = NO_MODEL, const glm::mat4 &extraWorld = glm::mat4(1.0f))
+    {
+        for(unsigned int m = 0; m < models.size(); m++)
+        {
+            selectedBody[m] = NO_MODEL;
+            selectedSize[m] = -1.0f;
+        }
+        glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+        for(unsigned int i = 0; i < bodies.size(); i++)
+        {
+            unsigned int m = bodies[i].model;
+            if(m != NO_MODEL && models[m])
+                consider(m, i, scene.world(bodies[i].node), eye);
+        }
+        // the extra placement counts as body number bodies.size()
+        if(extraModel != NO_MODEL && models[extraModel])
+            consider(extraModel, (unsigned int)bodies.size(), extraWorld, eye);
+        for(unsigned int m = 0; m < models.size(); m++)
+        {
+            unsigned int i = selectedBody[m];
+            if(i != NO_MODEL)
+                models[m]->selectLod(i < bodies.size() ? scene.world(bodies[i].node) : extraWorld, view, projection, viewportHeight);
+        }
+    }
+
+    // parse and build time of generated systems of 100 to 10000 bodies (--bench-system), a tree four wide where
+    // every other body shares one of a few models and the rest have their own. Returns whether the time per body
+    // at the largest size stays within MAX_GROWTH of the one at 1000 bodies.
+    static bool benchmark(ostream &log)
+    {
+        const unsigned int SIZES[] = { 100, 1000, 10000 };
+        const double MAX_GROWTH = 3.0;
+        const char *SHARED[] = { "resources/sun/planet.obj", "resources/earth/Model/Globe.obj", "resources/rock/rock/rock.obj" };
+        double msPerBody[3];
+        log << "StarSystem loading (best of 5)" << endl;
+        log << "    bodies    models    parse ms    build ms   ms per body" << endl;
+        for(int s = 0; s < 3; s++)
+        {
+            string source = "body b0 - - position=0,0,-50\n";
+            char line[256];
+            for(unsigned int i = 1; i < SIZES[s]; i++)
+            {
+                char model[64];
+                if(i % 2)
+                    snprintf(model, sizeof(model), "%s", SHARED[i / 2 % 3]);
+                else
+                    snprintf(model, sizeof(model), "bench/body%u.obj", i);
+                snprintf(line, sizeof(line), "body b%u b%u %s a=%u e=0.0%u i=%u orbitrate=%g spin=2 scale=0.1 shading=lit\n", i, (i - 1) / 4,
+                         model, 5 + i % 50, i % 10, i % 30, 1.0 / (1 + i % 7));
+                source += line;
+            }
+
+            Timings best;
+            best.parse = best.build = 1e30;
+            unsigned int modelCount = 0;
+            for(int run = 0; run < 5; run++)
+            {
+                string text = source;
+                text.push_back(0);
+                SceneGraph scene;
+                StarSystem system;
+                if(!system.parse("generated", text, scene))
+                    return false;
+                if(system.timings.parse + system.timings.build < best.parse + best.build)
+                    best = system.timings;
+                modelCount = (unsigned int)system.modelPaths.size();
+            }
+            msPerBody[s] = (best.parse + best.build) / SIZES[s];
+            log << setw(10) << SIZES[s] << setw(10) << modelCount << setw(12) << setprecision(3) << best.parse << setw(12)
+                << best.build << setw(14) << msPerBody[s] << endl;
+        }
+        bool ok = msPerBody[2] <= msPerBody[1] * MAX_GROWTH;
+        log << "  linear " << (ok ? "OK" : "FAILED") << " (bound: ms per body at " << SIZES[2] << " bodies <= " << MAX_GROWTH
+            << " x at " << SIZES[1] << ")" << endl;
+        return ok;
+    }
+
+private:
+    unordered_map<string, unsigned int> modelIndices;  // modelPaths to their index
+    Timings timings;
+    // per model scratch for selectLods(), sized at load so it doesn't allocate per frame
+    vector<unsigned int> selectedBody;
+    vector<float> selectedSize;
+    // positions from KeplerOrbits::propagate(), sized at load
+    vector<float> orbitX, orbitY, orbitZ;
+
+    StarSystem(const StarSystem&);
+    StarSystem& operator=(const StarSystem&);
+
+    // selects placement 'i' of model 'm' if it looks larger (size over distance) than the ones seen so far
+    void consider(unsigned int m, unsigned int i, const glm::mat4 &world, const glm::vec3 &eye)
+    {
+        float scale = max(glm::length(glm::vec3(world[0])), max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+        float size = scale / max(glm::length(glm::vec3(world[3]) - eye), 1e-6f);
+        if(size > selectedSize[m])
+        {
+            selectedSize[m] = size;
+            selectedBody[m] = i;
+        }
+    }
+
+    static bool readFile(const string &path, string &text)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if(!file)
+            return false;
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        text.resize(size > 0 ? (size_t)size : 0);
+        size_t read = size > 0 ? fread(&text[0], 1, (size_t)size, file) : 0;
+        fclose(file);
+        text.resize(read);
+        text.push_back(0);
+        return true;
+    }
+
+    // next whitespace separated token of 'line' (terminated in place, 'line' advanced past it), NULL at the end
+    static char *nextToken(char *&line)
+    {
+        while(*line == ' ' || *line == '\t' || *line == '\r')
+            line++;
+        if(!*line)
+            return NULL;
+        char *token = line;
+        while(*line && *line != ' ' && *line != '\t' && *line != '\r')
+            line++;
+        if(*line)
+            *line++ = 0;
+        return token;
+    }
+
+    static bool parseFloat(const char *text, float &value)
+    {
+        if(!text)
+            return false;
+        char *end;
+        value = strtof(text, &end);
+        return end != text && !*end;
+    }
+
+    // degrees to radians
+    static bool parseAngle(const char *text, float &value)
+    {
+        if(!parseFloat(text, value))
+            return false;
+        value = glm::radians(value);
+        return true;
+    }
+
+    // "x,y,z", or one value for all three
+    static bool parseVector(const char *text, glm::vec3 &value)
+    {
+        if(!text)
+            return false;
+        char *end;
+        value.x = value.y = value.z = strtof(text, &end);
+        if(end == text)
+            return false;
+        if(!*end)
+            return true;
+        for(int i = 1; i < 3; i++)
+        {
+            if(*end != ',')
+                return false;
+            text = end + 1;
+            value[i] = strtof(text, &end);
+            if(end == text)
+                return false;
+        }
+        return !*end;
+    }
+
+    static bool parseShading(const char *text, BodyShading &shading)
+    {
+        const char *names[] = { "emissive", "sunlit", "lit", "occludable" };
+        for(int i = 0; i < 4; i++)
+        {
+            if(text && !strcmp(text, names[i]))
+            {
+                shading = (BodyShading)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool error(const string &path, unsigned int line, const string &message)
+    {
+        cout << "ERROR::STAR_SYSTEM:: " << path << ":" << line << ": " << message << endl;
+        return false;
+    }
+};
+#endif
@@ -0,0 +1,147 @@
+#ifndef TEXTURE_IMAGE_H
+#define TEXTURE_IMAGE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/dds.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// a decoded image waiting to be uploaded as a texture
+struct TextureImage {
+    string path;
+    int width, height, nrComponents;
+    unsigned char *data;                // stb_image pixels, NULL for compressed images
+    GLenum compressedFormat;            // S3TC format of 'compressed', 0 for uncompressed images
+    int mipCount;
+    vector<unsigned char> compressed;   // all mip levels back to back, largest first
+};
+
+// decodes 'directory/path'; makes no GL calls so it can run on a worker thread.
+// with 'compress' set, RGB(A) images are block compressed with a full mip chain and cached next to the source
+// as '<image>.dds'; later loads read the DDS file instead of decoding and compressing again.
+inline bool LoadTextureImage(const char *path, const string &directory, TextureImage &image, bool compress = false)
+{
+    string filename = string(path);
+    filename = directory + '/' + filename;
+
+    image.path = path;
+    image.data = NULL;
+    image.compressedFormat = 0;
+    image.mipCount = 1;
+    image.compressed.clear();
+
+    string ddsPath = filename + ".dds";
+    if(compress && DDS::isFresh(ddsPath, filename))
+    {
+        image.compressedFormat = DDS::read(ddsPath, image.width, image.height, image.mipCount, image.compressed);
+        image.nrComponents = image.compressedFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 3 : 4;
+        if(image.compressedFormat)
+            return true;
+        image.compressed.clear();
+    }
+
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    if(!image.data || !compress)
+        return image.data != NULL;
+
+    image.compressedFormat = DDS::compress(image.data, image.width, image.height, image.nrComponents, image.compressed, image.mipCount);
+    if(!image.compressedFormat)
+    {
+        image.compressed.clear(); // 1 and 2 channel images stay uncompressed
+        return true;
+    }
+    if(!DDS::write(ddsPath, image.compressedFormat, image.width, image.height, image.mipCount, image.compressed))
+        std::cout << "WARNING::DDS:: could not write " << ddsPath << std::endl;
+    stbi_image_free(image.data);
+    image.data = NULL;
+    return true;
+}
+
+// creates a texture from a decoded image and frees the image data
+inline unsigned int TextureFromImage(TextureImage &image, bool gamma = false)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    int width = image.width, height = image.height, nrComponents = image.nrComponents;
+    unsigned char *data = image.data;
+    if (image.compressedFormat)
+    {
+        GLState::get().bindTexture(GL_TEXTURE_2D, textureID);
+        DDS::upload(image.compressedFormat, width, height, image.mipCount, image.compressed.data());
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        vector<unsigned char>().swap(image.compressed);
+    }
+    else if (data)
+    {
+        GLenum format;
+        if (nrComponents == 1)
+            format = GL_RED;
+        else if (nrComponents == 3)
+            format = GL_RGB;
+        else if (nrComponents == 4)
+            format = GL_RGBA;
+
+        GLState::get().bindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        stbi_image_free(data);
+    }
+    else
+    {
+        std::cout << "Texture failed to load at path: " << image.path << std::endl;
+    }
+    image.data = NULL;
+
+    return textureID;
+}
+
+// bytes of GL memory held by a 2D texture and its mip levels, as reported by the driver
+// (uncompressed formats are counted at their nominal size; the driver may pad RGB to 4 bytes)
+inline size_t TextureMemory(unsigned int textureID)
+{
+    GLState::get().bindTexture(GL_TEXTURE_2D, textureID);
+    size_t bytes = 0;
+    for(int level = 0; ; level++)
+    {
+        GLint width = 0, height = 0, compressed = 0, internalFormat = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if(width == 0 || height == 0)
+            break;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if(compressed)
+        {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            bytes += size;
+            continue;
+        }
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        size_t texelBytes = 4;
+        if(internalFormat == GL_RED || internalFormat == GL_R8)
+            texelBytes = 1;
+        else if(internalFormat == GL_RGB || internalFormat == GL_RGB8)
+            texelBytes = 3;
+        bytes += (size_t)width * height * texelBytes;
+    }
+    return bytes;
+}
+#endif
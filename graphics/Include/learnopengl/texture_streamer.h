@@ -0,0 +1,208 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/dds.h>
+#include <learnopengl/texture_image.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+using namespace std;
+
+// Streams textures in the background. request() returns a texture id right away that holds a 1x1 placeholder;
+// the image is decoded on a worker thread and update(), called once per frame on the GL thread, copies finished
+// images into a ring of orphaned pixel buffer objects and re-specifies the texture from there. The render loop
+// never waits on file I/O or decoding, and the texture id stays the same when the real image arrives.
+// Block compressed images (see LoadTextureImage) go through the same buffers with all of their mip levels.
+class TextureStreamer
+{
+public:
+    // number of pixel buffer objects cycled through by update()
+    static const unsigned int PBO_COUNT = 3;
+
+    // at most this many bytes are uploaded per update() (but always at least one image)
+    size_t uploadBudget;
+
+    TextureStreamer(size_t uploadBudget = 16 * 1024 * 1024) : uploadBudget(uploadBudget), nextPBO(0), inFlight(0), stopping(false)
+    {
+        for(unsigned int i = 0; i < PBO_COUNT; i++)
+            pbos[i] = 0;
+        worker = thread(&TextureStreamer::decodeLoop, this);
+    }
+
+    ~TextureStreamer()
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        worker.join();
+        for(unsigned int i = 0; i < decoded.size(); i++)
+            stbi_image_free(decoded[i].image.data);
+    }
+
+    // creates a texture showing the placeholder and queues 'directory/path' for streaming (GL thread only)
+    unsigned int request(const char *path, const string &directory, bool compress = false)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        GLState::get().bindTexture(GL_TEXTURE_2D, textureID);
+        const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        Job job;
+        job.textureID = textureID;
+        job.path = path;
+        job.directory = directory;
+        job.compress = compress;
+        job.image.data = NULL;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            requests.push_back(job);
+            inFlight++;
+        }
+        queueCondition.notify_one();
+        return textureID;
+    }
+
+    // uploads images that finished decoding since the last call (GL thread only, once per frame)
+    void update()
+    {
+        size_t uploaded = 0;
+        while(uploaded == 0 || uploaded < uploadBudget)
+        {
+            Job job;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                if(decoded.empty())
+                    return;
+                job = decoded.front();
+                decoded.pop_front();
+            }
+            uploaded += upload(job.textureID, job.image);
+            stbi_image_free(job.image.data);
+            lock_guard<mutex> lock(queueMutex);
+            inFlight--;
+        }
+    }
+
+    // number of requested textures that still show the placeholder
+    unsigned int pending()
+    {
+        lock_guard<mutex> lock(queueMutex);
+        return inFlight;
+    }
+
+    // deletes the pixel buffer objects; call while the GL context is still current
+    void release()
+    {
+        for(unsigned int i = 0; i < PBO_COUNT; i++)
+            if(pbos[i])
+                GLState::get().deleteBuffers(1, &pbos[i]);
+        for(unsigned int i = 0; i < PBO_COUNT; i++)
+            pbos[i] = 0;
+    }
+
+private:
+    struct Job {
+        unsigned int textureID;
+        string path;
+        string directory;
+        bool compress;
+        TextureImage image;
+    };
+
+    unsigned int pbos[PBO_COUNT];
+    unsigned int nextPBO;
+    unsigned int inFlight;
+    bool stopping;
+    deque<Job> requests;
+    deque<Job> decoded;
+    mutex queueMutex;
+    condition_variable queueCondition;
+    thread worker;
+
+    void decodeLoop()
+    {
+        for(;;)
+        {
+            Job job;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || !requests.empty(); });
+                if(stopping)
+                    return;
+                job = requests.front();
+                requests.pop_front();
+            }
+            if(!LoadTextureImage(job.path.c_str(), job.directory, job.image, job.compress))
+                std::cout << "Texture failed to load at path: " << job.path << std::endl;
+            lock_guard<mutex> lock(queueMutex);
+            decoded.push_back(job);
+        }
+    }
+
+    // copies a decoded image into the next pixel buffer object and specifies the texture from it.
+    // returns the number of bytes uploaded.
+    size_t upload(unsigned int textureID, TextureImage &image)
+    {
+        const unsigned char *pixels = image.compressedFormat ? image.compressed.data() : image.data;
+        if(!pixels)
+            return 0; // keep the placeholder
+
+        GLenum format = GL_RGBA;
+        if (image.nrComponents == 1)
+            format = GL_RED;
+        else if (image.nrComponents == 3)
+            format = GL_RGB;
+        size_t size = image.compressedFormat ? image.compressed.size() : (size_t)image.width * image.height * image.nrComponents;
+
+        if(!pbos[0])
+            glGenBuffers(PBO_COUNT, pbos);
+        GLState::get().bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextPBO]);
+        nextPBO = (nextPBO + 1) % PBO_COUNT;
+        // orphan the previous storage so the driver never has to wait for an earlier transfer to finish
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if(mapped)
+        {
+            memcpy(mapped, pixels, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            GLState::get().bindTexture(GL_TEXTURE_2D, textureID);
+            if(image.compressedFormat)
+            {
+                // with a pixel unpack buffer bound the data pointer is an offset into it
+                DDS::upload(image.compressedFormat, image.width, image.height, image.mipCount, (const unsigned char*)0);
+            }
+            else
+            {
+                // rows of 1 and 3 channel images aren't necessarily 4 byte aligned
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, (void*)0);
+                glGenerateMipmap(GL_TEXTURE_2D);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        }
+        GLState::get().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return size;
+    }
+
+    TextureStreamer(const TextureStreamer&);
+    TextureStreamer& operator=(const TextureStreamer&);
+};
+#endif
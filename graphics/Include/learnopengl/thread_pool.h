@@ -0,0 +1,95 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run queued tasks in FIFO order. Tasks may enqueue further tasks;
+// wait() returns once the queue is empty and every worker is idle.
+class ThreadPool
+{
+public:
+    // starts 'threadCount' workers, or one per hardware thread when 0
+    explicit ThreadPool(unsigned int threadCount = 0) : running(0), stopping(false)
+    {
+        if(threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if(threadCount == 0)
+            threadCount = 2;
+        for(unsigned int i = 0; i < threadCount; i++)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        taskAvailable.notify_all();
+        for(unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    void enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        taskAvailable.notify_one();
+    }
+
+    // blocks until all queued (and transitively enqueued) tasks have finished
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return tasks.empty() && running == 0; });
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable idle;
+    unsigned int running;
+    bool stopping;
+
+    void workerLoop()
+    {
+        for(;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if(tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                running++;
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running--;
+                if(tasks.empty() && running == 0)
+                    idle.notify_all();
+            }
+        }
+    }
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+};
+#endif
@@ -0,0 +1,118 @@
+#ifndef UNIFORM_BUFFERS_H
+#define UNIFORM_BUFFERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader.h>
+
+#include <cstddef>
+#include <cstring>
+using namespace std;
+
+// Per frame state shared by every program through std140 uniform blocks. Each block has a fixed binding point
+// (GLSL 330 can't declare it in the shader, so BindUniformBlocks() assigns it after linking); a buffer bound
+// there once is seen by all programs, so the camera is uploaded once per frame instead of once per program.
+// The structs mirror the GLSL declarations byte for byte, see the shaders that use them.
+const unsigned int CAMERA_BLOCK_BINDING = 0;
+const unsigned int LIGHT_BLOCK_BINDING = 1;
+const unsigned int MATERIAL_BLOCK_BINDING = 2;
+
+// layout (std140) uniform CameraBlock { mat4 projection; mat4 view; vec4 viewPos; } camera;
+struct CameraBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPos;
+};
+
+// layout (std140) uniform LightBlock { vec3 position; vec3 ambient; vec3 diffuse; vec3 specular;
+//                                      float constant; float linear; float quadratic; } light;
+// a vec3 is aligned to 16 bytes, and 'constant' fills the last 4 bytes of 'specular's slot
+struct LightBlock {
+    glm::vec3 position;
+    float padding0;
+    glm::vec3 ambient;
+    float padding1;
+    glm::vec3 diffuse;
+    float padding2;
+    glm::vec3 specular;
+    float constant;
+    float linear;
+    float quadratic;
+    float padding3[2];
+};
+
+// layout (std140) uniform MaterialBlock { float shininess; } materialParams;
+// (samplers can't live in a uniform block and stay plain uniforms)
+struct MaterialBlock {
+    float shininess;
+    float padding[3];
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match its std140 layout");
+static_assert(offsetof(LightBlock, constant) == 60 && sizeof(LightBlock) == 80, "LightBlock must match its std140 layout");
+static_assert(sizeof(MaterialBlock) == 16, "MaterialBlock must match its std140 layout");
+
+// a uniform buffer holding one block. update() only touches the buffer when the contents changed.
+template <class T>
+class UniformBuffer
+{
+public:
+    // creates the buffer and binds it to 'binding' (GL thread only)
+    UniformBuffer(unsigned int binding) : binding(binding), known(false)
+    {
+        glGenBuffers(1, &ID);
+        GLState::get().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        GLState::get().bindBuffer(GL_UNIFORM_BUFFER, 0);
+        bind();
+    }
+
+    // uploads 'data' unless the buffer already holds it
+    void update(const T &data)
+    {
+        if(known && memcmp(&value, &data, sizeof(T)) == 0)
+            return;
+        value = data;
+        known = true;
+        GLState::get().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &value);
+    }
+
+    // makes this buffer the one programs read at its binding point (e.g. to switch between two lights)
+    void bind()
+    {
+        GLState::get().bindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    // deletes the buffer; call while the GL context is still current
+    void release()
+    {
+        GLState::get().deleteBuffers(1, &ID);
+        ID = 0;
+    }
+
+private:
+    unsigned int ID;
+    unsigned int binding;
+    bool known;
+    T value;
+
+    UniformBuffer(const UniformBuffer&);
+    UniformBuffer& operator=(const UniformBuffer&);
+};
+
+// connects the blocks a program declares to their binding points; blocks it doesn't use are skipped
+inline void BindUniformBlocks(Shader &shader)
+{
+    const char *names[] = { "CameraBlock", "LightBlock", "MaterialBlock" };
+    const unsigned int bindings[] = { CAMERA_BLOCK_BINDING, LIGHT_BLOCK_BINDING, MATERIAL_BLOCK_BINDING };
+    for(unsigned int i = 0; i < 3; i++)
+    {
+        unsigned int index = glGetUniformBlockIndex(shader.ID, names[i]);
+        if(index != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, index, bindings[i]);
+    }
+}
+#endif
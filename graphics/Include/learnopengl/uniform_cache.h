@@ -0,0 +1,233 @@
+#ifndef UNIFORM_CACHE_H
+#define UNIFORM_CACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Uniform handles and shadow values shared by the Shader classes (shader.h, shader_m.h). Shader derives from it
+// and calls reflectUniforms() once the program is linked; set calls then go through a handle (or a name, looked
+// up by binary search) and reach the driver only when the value differs from the one the program already has.
+class UniformCache
+{
+public:
+    // uniform handles
+    // ------------------------------------------------------------------------
+    // returns a handle for the named uniform that the set functions below take instead of the name, or -1 if the
+    // program has no such active uniform (setting it is then a no-op). Look handles up once and keep them.
+    int uniform(const char *name) const
+    {
+        size_t first = 0, last = uniformNames.size();
+        while(first < last)
+        {
+            size_t middle = (first + last) / 2;
+            int order = std::strcmp(uniformNames[middle].first.c_str(), name);
+            if(order == 0)
+                return uniformNames[middle].second;
+            if(order < 0)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        return -1;
+    }
+    int uniform(const std::string &name) const
+    {
+        return uniform(name.c_str());
+    }
+    // values sent to the driver and set calls skipped because the uniform already had that value, since the
+    // last resetCounters() (call it once per frame to get per frame numbers)
+    unsigned int uniformUploads() const { return uploads; }
+    unsigned int skippedUploads() const { return skipped; }
+    void resetCounters()
+    {
+        uploads = 0;
+        skipped = 0;
+    }
+    // utility uniform functions, only values that differ from what the program already has are uploaded
+    // (the program must be in use, as before)
+    // ------------------------------------------------------------------------
+    void setBool(int handle, bool value)
+    {
+        setInt(handle, (int)value);
+    }
+    void setBool(const std::string &name, bool value)
+    {         
+        setInt(uniform(name), (int)value);
+    }
+    // ------------------------------------------------------------------------
+    void setInt(int handle, int value)
+    { 
+        if(changed(handle, &value, sizeof(value)))
+            glUniform1i(uniforms[handle].location, value);
+    }
+    void setInt(const std::string &name, int value)
+    { 
+        setInt(uniform(name), value);
+    }
+    // ------------------------------------------------------------------------
+    void setFloat(int handle, float value)
+    { 
+        if(changed(handle, &value, sizeof(value)))
+            glUniform1f(uniforms[handle].location, value);
+    }
+    void setFloat(const std::string &name, float value)
+    { 
+        setFloat(uniform(name), value);
+    }
+    // ------------------------------------------------------------------------
+    void setVec2(int handle, const glm::vec2 &value)
+    { 
+        if(changed(handle, &value[0], sizeof(value)))
+            glUniform2fv(uniforms[handle].location, 1, &value[0]);
+    }
+    void setVec2(const std::string &name, const glm::vec2 &value)
+    { 
+        setVec2(uniform(name), value);
+    }
+    void setVec2(const std::string &name, float x, float y)
+    { 
+        setVec2(uniform(name), glm::vec2(x, y));
+    }
+    // ------------------------------------------------------------------------
+    void setVec3(int handle, const glm::vec3 &value)
+    { 
+        if(changed(handle, &value[0], sizeof(value)))
+            glUniform3fv(uniforms[handle].location, 1, &value[0]);
+    }
+    void setVec3(const std::string &name, const glm::vec3 &value)
+    { 
+        setVec3(uniform(name), value);
+    }
+    void setVec3(const std::string &name, float x, float y, float z)
+    { 
+        setVec3(uniform(name), glm::vec3(x, y, z));
+    }
+    // ------------------------------------------------------------------------
+    void setVec4(int handle, const glm::vec4 &value)
+    { 
+        if(changed(handle, &value[0], sizeof(value)))
+            glUniform4fv(uniforms[handle].location, 1, &value[0]);
+    }
+    void setVec4(const std::string &name, const glm::vec4 &value)
+    { 
+        setVec4(uniform(name), value);
+    }
+    void setVec4(const std::string &name, float x, float y, float z, float w)
+    { 
+        setVec4(uniform(name), glm::vec4(x, y, z, w));
+    }
+    // ------------------------------------------------------------------------
+    void setMat2(int handle, const glm::mat2 &mat)
+    {
+        if(changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix2fv(uniforms[handle].location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat2(const std::string &name, const glm::mat2 &mat)
+    {
+        setMat2(uniform(name), mat);
+    }
+    // ------------------------------------------------------------------------
+    void setMat3(int handle, const glm::mat3 &mat)
+    {
+        if(changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix3fv(uniforms[handle].location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(const std::string &name, const glm::mat3 &mat)
+    {
+        setMat3(uniform(name), mat);
+    }
+    // ------------------------------------------------------------------------
+    void setMat4(int handle, const glm::mat4 &mat)
+    {
+        if(changed(handle, &mat[0][0], sizeof(mat)))
+            glUniformMatrix4fv(uniforms[handle].location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(const std::string &name, const glm::mat4 &mat)
+    {
+        setMat4(uniform(name), mat);
+    }
+
+protected:
+    UniformCache() : uploads(0), skipped(0)
+    {
+    }
+
+    // fills the uniform table from the linked 'program'. Array elements get a handle each, the bare array name
+    // refers to element 0 (as it does for glGetUniformLocation).
+    // ------------------------------------------------------------------------
+    void reflectUniforms(unsigned int program)
+    {
+        uploads = 0;
+        skipped = 0;
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> buffer(maxLength + 1);
+        for(GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)buffer.size(), NULL, &size, &type, &buffer[0]);
+            std::string name(&buffer[0]);
+            size_t bracket = name.find("[0]");
+            bool isArray = bracket != std::string::npos && bracket + 3 == name.size();
+            if(isArray)
+                name.erase(bracket);
+            for(GLint element = 0; element < (isArray ? size : 1); element++)
+            {
+                std::string elementName = isArray ? name + "[" + std::to_string(element) + "]" : name;
+                Uniform u;
+                u.location = glGetUniformLocation(program, elementName.c_str());
+                if(u.location < 0)
+                    continue; // uniform block members have no location
+                u.known = false;
+                uniformNames.push_back(std::make_pair(elementName, (int)uniforms.size()));
+                if(isArray && element == 0)
+                    uniformNames.push_back(std::make_pair(name, (int)uniforms.size()));
+                uniforms.push_back(u);
+            }
+        }
+        std::sort(uniformNames.begin(), uniformNames.end());
+    }
+
+private:
+    // an active uniform of the program and the last value set through this class
+    struct Uniform {
+        GLint location;
+        bool known;	// false until the first set, the value the program starts with isn't tracked
+        float value[16];
+    };
+    std::vector<Uniform> uniforms;	// indexed by handle
+    std::vector<std::pair<std::string, int> > uniformNames;	// name -> handle, sorted by name
+    unsigned int uploads;
+    unsigned int skipped;
+
+    // records 'value' as the uniform's value; false if it already had it (or the handle is -1), so nothing needs
+    // to be uploaded
+    // ------------------------------------------------------------------------
+    bool changed(int handle, const void *value, size_t bytes)
+    {
+        if(handle < 0)
+            return false;
+        Uniform &u = uniforms[handle];
+        if(u.known && std::memcmp(u.value, value, bytes) == 0)
+        {
+            skipped++;
+            return false;
+        }
+        std::memcpy(u.value, value, bytes);
+        u.known = true;
+        uploads++;
+        return true;
+    }
+
+    UniformCache(const UniformCache&);
+    UniformCache& operator=(const UniformCache&);
+};
+#endif
@@ -0,0 +1,704 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Virtual texturing
+// -----------------
+// Images too large to live in a single GL texture are cut into pages once ("<image>.vtpages", next to the
+// image): the image is treated as the top left corner of a square virtual texture of VT_PAGE_SIZE << (levels-1)
+// texels, and every mip level of it is stored as VT_PAGE_SIZE^2 pages with a VT_PAGE_BORDER texel border so
+// bilinear filtering never reads a neighbouring page. Pages that lie completely outside the image aren't stored.
+//
+// At run time only a fixed number of pages is resident, in one atlas texture. A small feedback pass renders the
+// virtually textured objects with vt_feedback.fs, which writes the page (x, y, level) each pixel needs; the result
+// is read back through pixel buffer objects a few frames later, missing pages are read from the memory mapped page
+// file on a worker thread and copied into the least recently used atlas slots. An indirection texture (one texel
+// per page, with one mip level per page level) maps every page to its atlas slot, or to the slot of the closest
+// resident coarser page while it is still loading. The coarsest page is always resident.
+//
+// GPU memory is the atlas plus 4 bytes per level 0 page of indirection, independent of the image resolution.
+
+const unsigned int VT_MAGIC       = 0x58455456; // "VTEX"
+const unsigned int VT_VERSION     = 1;
+const unsigned int VT_PAGE_SIZE   = 128;        // texels per page side, without the border
+const unsigned int VT_PAGE_BORDER = 4;
+const unsigned int VT_SLOT_SIZE   = VT_PAGE_SIZE + 2 * VT_PAGE_BORDER;
+const unsigned int VT_NO_PAGE     = 0xFFFFFFFF;
+
+// page file: VirtualTextureHeader, page index table, pages from dataOffset on
+struct VirtualTextureHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long sourceTime;  // st_mtime of the source image
+    unsigned long long sourceSize;
+    unsigned int width, height;     // source image size
+    unsigned int channels;          // 1, 3 or 4
+    unsigned int levels;
+    unsigned int pageCount;         // pages stored in the file
+    unsigned int tableSize;         // entries in the index table, one per page of every level's grid
+    unsigned long long dataOffset;
+};
+
+class VirtualTexture
+{
+public:
+    // number of pixel buffer objects the feedback is read back through
+    static const unsigned int FEEDBACK_PBO_COUNT = 3;
+
+    // 'atlasPages' slots per atlas side; at most 'uploadsPerFrame' pages are copied into the atlas per update().
+    // the feedback pass renders at 1/'feedbackScale' of the framebuffer resolution.
+    VirtualTexture(unsigned int atlasPages = 16, unsigned int uploadsPerFrame = 8, unsigned int feedbackScale = 8)
+        : atlasPages(atlasPages), uploadsPerFrame(uploadsPerFrame), feedbackScale(feedbackScale),
+          atlas(0), indirection(0), feedbackFBO(0), feedbackColor(0), feedbackDepth(0), feedbackWidth(0), feedbackHeight(0),
+          nextFeedback(0), frame(1), indirectionDirty(false), stopping(false)
+    {
+        for(unsigned int i = 0; i < FEEDBACK_PBO_COUNT; i++)
+        {
+            feedbackPBOs[i] = 0;
+            feedbackPixels[i] = 0;
+        }
+        memset(&header, 0, sizeof(header));
+    }
+
+    ~VirtualTexture()
+    {
+        stopWorker();
+    }
+
+    // pages 'imagePath' (if the page file is missing or older than the image) and creates the GL objects.
+    // must be called on the GL thread.
+    bool load(string const &imagePath)
+    {
+        string pagePath = imagePath + ".vtpages";
+        if(!open(pagePath, imagePath))
+        {
+            if(!build(imagePath, pagePath) || !open(pagePath, imagePath))
+            {
+                cout << "ERROR::VIRTUAL_TEXTURE:: could not page " << imagePath << endl;
+                return false;
+            }
+        }
+
+        // grid of every level, coarsest level last
+        unsigned int offset = 0;
+        levelOffsets.resize(header.levels);
+        for(unsigned int level = 0; level < header.levels; level++)
+        {
+            levelOffsets[level] = offset;
+            offset += gridSize(level) * gridSize(level);
+        }
+        pageSlots.assign(header.tableSize, -1);
+        pageState.assign(header.tableSize, 0);
+        requestFrames.assign(header.tableSize, 0);
+        slots.assign(atlasPages * atlasPages, Slot());
+
+        GLenum format = pixelFormat();
+        glGenTextures(1, &atlas);
+        GLState::get().bindTexture(GL_TEXTURE_2D, atlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat(), atlasSize(), atlasSize(), 0, format, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        if(header.channels == 1)
+        {
+            // grey images are stored with one channel and read back as grey
+            GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+
+        glGenTextures(1, &indirection);
+        GLState::get().bindTexture(GL_TEXTURE_2D, indirection);
+        for(unsigned int level = 0; level < header.levels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, gridSize(level), gridSize(level), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levels - 1);
+        indirectionData.resize(offset * 4);
+
+        // the coarsest page is loaded right away and never evicted, so every pixel always has something to show
+        unsigned int top = levelOffsets[header.levels - 1];
+        vector<unsigned char> page;
+        readPage(top, page);
+        uploadPage(top, 0, page);
+        slots[0].pinned = true;
+        rebuildIndirection();
+
+        worker = thread(&VirtualTexture::loadLoop, this);
+
+        cout << "VirtualTexture: " << imagePath << " " << header.width << "x" << header.height << ", "
+             << header.pageCount << " pages in " << header.levels << " levels, atlas " << atlasSize() << "x" << atlasSize()
+             << " (" << (residentBytes() >> 10) << " KB resident)" << endl;
+        return true;
+    }
+
+    // binds the atlas and indirection textures and sets the 'vt' uniforms of vt_feedback.fs and of shaders using
+    // vtSample() ('shader' must be in use); the feedback pass passes its own lod bias
+    void bind(Shader &shader, unsigned int atlasUnit = 4, unsigned int indirectionUnit = 5, float lodBias = 0.0f)
+    {
+        GLState::get().bindTexture(atlasUnit, GL_TEXTURE_2D, atlas);
+        GLState::get().bindTexture(indirectionUnit, GL_TEXTURE_2D, indirection);
+
+        float virtualSize = (float)(VT_PAGE_SIZE << (header.levels - 1));
+        shader.setInt("vt.atlas", atlasUnit);
+        shader.setInt("vt.indirection", indirectionUnit);
+        shader.setVec2("vt.scale", header.width / virtualSize, header.height / virtualSize);
+        shader.setFloat("vt.virtualSize", virtualSize);
+        shader.setFloat("vt.maxLevel", (float)(header.levels - 1));
+        shader.setFloat("vt.pageSize", (float)VT_PAGE_SIZE);
+        shader.setFloat("vt.border", (float)VT_PAGE_BORDER);
+        shader.setFloat("vt.atlasSize", (float)atlasSize());
+        shader.setFloat("vt.lodBias", lodBias);
+    }
+
+    // redirects rendering into the feedback framebuffer (sized for a 'width' x 'height' screen) and binds
+    // 'feedbackShader'; draw the virtually textured objects with it, then call endFeedback()
+    void beginFeedback(Shader &feedbackShader, int width, int height)
+    {
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        int w = max(width / (int)feedbackScale, 1), h = max(height / (int)feedbackScale, 1);
+        if(w != feedbackWidth || h != feedbackHeight)
+            createFeedback(w, h);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+        glViewport(0, 0, feedbackWidth, feedbackHeight);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        feedbackShader.use();
+        // derivatives at the feedback resolution are feedbackScale times larger than on screen
+        bind(feedbackShader, 4, 5, -log2f((float)feedbackScale));
+    }
+
+    // starts reading the feedback back (without waiting for it) and restores the default framebuffer
+    void endFeedback()
+    {
+        GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBOs[nextFeedback]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedbackPixels[nextFeedback] = feedbackWidth * feedbackHeight;
+        nextFeedback = (nextFeedback + 1) % FEEDBACK_PBO_COUNT;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    }
+
+    // once per frame on the GL thread: reads the oldest feedback, queues missing pages and copies loaded pages
+    // into the atlas
+    void update()
+    {
+        frame++;
+        // the buffer written FEEDBACK_PBO_COUNT - 1 frames ago has finished transferring by now
+        unsigned int oldest = nextFeedback;
+        if(feedbackPixels[oldest])
+        {
+            GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBOs[oldest]);
+            const unsigned char *pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                                                                 feedbackPixels[oldest] * 4, GL_MAP_READ_BIT);
+            if(pixels)
+            {
+                processFeedback(pixels, feedbackPixels[oldest]);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            feedbackPixels[oldest] = 0;
+        }
+
+        for(unsigned int uploads = 0; uploads < uploadsPerFrame; uploads++)
+        {
+            LoadedPage loaded;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                if(loadedPages.empty())
+                    break;
+                loaded.page = loadedPages.front().page;
+                loaded.data.swap(loadedPages.front().data);
+                loadedPages.pop_front();
+            }
+            pageState[loaded.page] = 0;
+            int slot = freeSlot();
+            if(slot >= 0)
+                uploadPage(loaded.page, slot, loaded.data);
+        }
+
+        if(indirectionDirty)
+            rebuildIndirection();
+    }
+
+    // number of atlas slots holding a page
+    unsigned int residentPages() const
+    {
+        unsigned int count = 0;
+        for(unsigned int i = 0; i < slots.size(); i++)
+            if(slots[i].page != VT_NO_PAGE)
+                count++;
+        return count;
+    }
+
+    // GPU memory used by the atlas and the indirection texture
+    size_t residentBytes() const
+    {
+        return (size_t)atlasSize() * atlasSize() * header.channels + indirectionData.size();
+    }
+
+    // deletes the GL objects; call while the GL context is still current
+    void release()
+    {
+        stopWorker();
+        if(atlas)
+            GLState::get().deleteTextures(1, &atlas);
+        if(indirection)
+            GLState::get().deleteTextures(1, &indirection);
+        deleteFeedback();
+        if(feedbackPBOs[0])
+            GLState::get().deleteBuffers(FEEDBACK_PBO_COUNT, feedbackPBOs);
+        atlas = indirection = 0;
+        for(unsigned int i = 0; i < FEEDBACK_PBO_COUNT; i++)
+            feedbackPBOs[i] = 0;
+    }
+
+    // cuts 'imagePath' into the page file 'pagePath'
+    static bool build(string const &imagePath, string const &pagePath)
+    {
+        int width, height, channels;
+        unsigned char *pixels = stbi_load(imagePath.c_str(), &width, &height, &channels, 0);
+        if(pixels && channels == 2)
+        {
+            stbi_image_free(pixels);
+            pixels = stbi_load(imagePath.c_str(), &width, &height, &channels, 4);
+            channels = 4;
+        }
+        if(!pixels)
+            return false;
+
+        VirtualTextureHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = VT_MAGIC;
+        header.version = VT_VERSION;
+        MeshCache::sourceStamp(imagePath, header.sourceTime, header.sourceSize);
+        header.width = width;
+        header.height = height;
+        header.channels = channels;
+        header.levels = 1;
+        while((VT_PAGE_SIZE << (header.levels - 1)) < (unsigned int)max(width, height))
+            header.levels++;
+
+        // index every page that overlaps its level's image
+        vector<unsigned int> table;
+        for(unsigned int level = 0; level < header.levels; level++)
+        {
+            unsigned int grid = 1u << (header.levels - 1 - level);
+            unsigned int w = levelExtent(width, level), h = levelExtent(height, level);
+            for(unsigned int y = 0; y < grid; y++)
+                for(unsigned int x = 0; x < grid; x++)
+                    table.push_back(x * VT_PAGE_SIZE < w && y * VT_PAGE_SIZE < h ? header.pageCount++ : VT_NO_PAGE);
+        }
+        header.tableSize = (unsigned int)table.size();
+        header.dataOffset = (sizeof(header) + table.size() * sizeof(unsigned int) + 4095) & ~(unsigned long long)4095;
+
+        string tempPath = pagePath + ".tmp";
+        ofstream out(tempPath.c_str(), ios::binary | ios::trunc);
+        if(!out)
+        {
+            stbi_image_free(pixels);
+            return false;
+        }
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)table.data(), table.size() * sizeof(unsigned int));
+        vector<char> padding((size_t)header.dataOffset - sizeof(header) - table.size() * sizeof(unsigned int), 0);
+        out.write(padding.data(), padding.size());
+
+        vector<unsigned char> level, next, page((size_t)VT_SLOT_SIZE * VT_SLOT_SIZE * channels);
+        level.assign(pixels, pixels + (size_t)width * height * channels);
+        stbi_image_free(pixels);
+        int w = width, h = height;
+        for(unsigned int l = 0; l < header.levels; l++)
+        {
+            unsigned int grid = 1u << (header.levels - 1 - l);
+            for(unsigned int y = 0; y < grid && y * VT_PAGE_SIZE < (unsigned int)h; y++)
+            {
+                for(unsigned int x = 0; x < grid && x * VT_PAGE_SIZE < (unsigned int)w; x++)
+                {
+                    cutPage(level, w, h, channels, x, y, page);
+                    out.write((const char*)page.data(), page.size());
+                }
+            }
+            if(l + 1 < header.levels)
+            {
+                downsample(level, w, h, channels, next);
+                level.swap(next);
+                w = (w + 1) / 2;
+                h = (h + 1) / 2;
+            }
+        }
+        out.close();
+        if(!out)
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        std::remove(pagePath.c_str());
+        return std::rename(tempPath.c_str(), pagePath.c_str()) == 0;
+    }
+
+private:
+    struct Slot {
+        unsigned int page;
+        unsigned int lastUsed;  // frame the page was last requested by the feedback
+        bool pinned;
+        Slot() : page(VT_NO_PAGE), lastUsed(0), pinned(false) {}
+    };
+
+    struct LoadedPage {
+        unsigned int page;
+        vector<unsigned char> data;
+    };
+
+    // pageState values
+    static const unsigned char PAGE_QUEUED = 1;
+
+    unsigned int atlasPages, uploadsPerFrame, feedbackScale;
+    MappedFile file;
+    VirtualTextureHeader header;
+    const unsigned int *table;
+
+    unsigned int atlas, indirection;
+    vector<unsigned int> levelOffsets;      // first page id of every level
+    vector<int> pageSlots;                  // atlas slot of every page id, -1 if not resident
+    vector<unsigned char> pageState;
+    vector<unsigned int> requestFrames;     // last frame a page id was seen in the feedback
+    vector<Slot> slots;
+    vector<unsigned char> indirectionData;  // every level back to back, 4 bytes per page
+
+    unsigned int feedbackFBO, feedbackColor, feedbackDepth;
+    int feedbackWidth, feedbackHeight;
+    unsigned int feedbackPBOs[FEEDBACK_PBO_COUNT];
+    unsigned int feedbackPixels[FEEDBACK_PBO_COUNT];
+    unsigned int nextFeedback;
+    GLint savedViewport[4];
+
+    unsigned int frame;
+    bool indirectionDirty;
+
+    deque<unsigned int> pageRequests;
+    deque<LoadedPage> loadedPages;
+    mutex queueMutex;
+    condition_variable queueCondition;
+    bool stopping;
+    thread worker;
+
+    // maps the page file and checks it still belongs to 'imagePath'
+    bool open(string const &pagePath, string const &imagePath)
+    {
+        unsigned long long time, size;
+        if(!MeshCache::sourceStamp(imagePath, time, size) || !file.open(pagePath))
+            return false;
+        if(file.size < sizeof(VirtualTextureHeader))
+        {
+            file.close();
+            return false;
+        }
+        memcpy(&header, file.data, sizeof(header));
+        size_t pageBytes = (size_t)VT_SLOT_SIZE * VT_SLOT_SIZE * header.channels;
+        bool valid = header.magic == VT_MAGIC && header.version == VT_VERSION && header.sourceTime == time &&
+                     header.sourceSize == size && header.levels > 0 && header.levels <= 16 &&
+                     (header.channels == 1 || header.channels == 3 || header.channels == 4) &&
+                     sizeof(header) + (size_t)header.tableSize * sizeof(unsigned int) <= header.dataOffset &&
+                     header.dataOffset + (size_t)header.pageCount * pageBytes <= file.size;
+        if(!valid)
+        {
+            file.close();
+            return false;
+        }
+        table = (const unsigned int*)(file.data + sizeof(header));
+        return true;
+    }
+
+    unsigned int gridSize(unsigned int level) const
+    {
+        return 1u << (header.levels - 1 - level);
+    }
+
+    int atlasSize() const
+    {
+        return (int)(atlasPages * VT_SLOT_SIZE);
+    }
+
+    GLenum pixelFormat() const
+    {
+        return header.channels == 1 ? GL_RED : (header.channels == 3 ? GL_RGB : GL_RGBA);
+    }
+
+    GLenum internalFormat() const
+    {
+        return header.channels == 1 ? GL_R8 : (header.channels == 3 ? GL_RGB8 : GL_RGBA8);
+    }
+
+    // copies a page out of the mapping; on the worker thread this is where the disk reads happen
+    void readPage(unsigned int page, vector<unsigned char> &data) const
+    {
+        size_t pageBytes = (size_t)VT_SLOT_SIZE * VT_SLOT_SIZE * header.channels;
+        const unsigned char *source = file.data + header.dataOffset + (size_t)table[page] * pageBytes;
+        data.assign(source, source + pageBytes);
+    }
+
+    void uploadPage(unsigned int page, int slot, const vector<unsigned char> &data)
+    {
+        if(slots[slot].page != VT_NO_PAGE)
+            pageSlots[slots[slot].page] = -1;
+        slots[slot].page = page;
+        slots[slot].lastUsed = frame;
+        pageSlots[page] = slot;
+
+        GLState::get().bindTexture(GL_TEXTURE_2D, atlas);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % atlasPages) * VT_SLOT_SIZE, (slot / atlasPages) * VT_SLOT_SIZE,
+                        VT_SLOT_SIZE, VT_SLOT_SIZE, pixelFormat(), GL_UNSIGNED_BYTE, data.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        indirectionDirty = true;
+    }
+
+    // an empty slot, else the least recently used one that wasn't needed this frame; -1 if the atlas is full
+    int freeSlot() const
+    {
+        int best = -1;
+        for(unsigned int i = 0; i < slots.size(); i++)
+        {
+            if(slots[i].page == VT_NO_PAGE)
+                return i;
+            if(!slots[i].pinned && slots[i].lastUsed < frame && (best < 0 || slots[i].lastUsed < slots[best].lastUsed))
+                best = i;
+        }
+        return best;
+    }
+
+    // collects the pages seen in the feedback, marks resident ones as used and queues the missing ones,
+    // together with their missing parents, coarsest first
+    void processFeedback(const unsigned char *pixels, unsigned int count)
+    {
+        vector<unsigned int> missing;
+        for(unsigned int i = 0; i < count; i++)
+        {
+            const unsigned char *p = pixels + i * 4;
+            if(p[3] == 0 || p[3] > header.levels)
+                continue; // background
+            unsigned int level = p[3] - 1;
+            unsigned int x = p[0] | ((p[2] & 15) << 8), y = p[1] | ((p[2] >> 4) << 8);
+            for(; level < header.levels; level++, x >>= 1, y >>= 1)
+            {
+                if(x >= gridSize(level) || y >= gridSize(level))
+                    break;
+                unsigned int page = levelOffsets[level] + y * gridSize(level) + x;
+                if(requestFrames[page] == frame)
+                    break; // this page and its parents were handled already
+                requestFrames[page] = frame;
+                if(pageSlots[page] >= 0)
+                    slots[pageSlots[page]].lastUsed = frame;
+                else if(!pageState[page] && table[page] != VT_NO_PAGE)
+                    missing.push_back(page);
+            }
+        }
+        if(missing.empty())
+            return;
+        // page ids grow towards the coarse levels
+        sort(missing.begin(), missing.end(), greater<unsigned int>());
+        {
+            lock_guard<mutex> lock(queueMutex);
+            for(unsigned int i = 0; i < missing.size(); i++)
+            {
+                pageState[missing[i]] = PAGE_QUEUED;
+                pageRequests.push_back(missing[i]);
+            }
+        }
+        queueCondition.notify_one();
+    }
+
+    // every indirection texel points at its own page's slot, or inherits the entry of its parent
+    void rebuildIndirection()
+    {
+        for(int level = header.levels - 1; level >= 0; level--)
+        {
+            unsigned int grid = gridSize(level);
+            for(unsigned int y = 0; y < grid; y++)
+            {
+                for(unsigned int x = 0; x < grid; x++)
+                {
+                    unsigned int page = levelOffsets[level] + y * grid + x;
+                    unsigned char *entry = &indirectionData[page * 4];
+                    int slot = pageSlots[page];
+                    if(slot >= 0)
+                    {
+                        entry[0] = (unsigned char)(slot % atlasPages);
+                        entry[1] = (unsigned char)(slot / atlasPages);
+                        entry[2] = (unsigned char)level;
+                        entry[3] = 255;
+                    }
+                    else
+                    {
+                        unsigned int parent = levelOffsets[level + 1] + (y >> 1) * (grid >> 1) + (x >> 1);
+                        memcpy(entry, &indirectionData[parent * 4], 4);
+                    }
+                }
+            }
+        }
+
+        GLState::get().bindTexture(GL_TEXTURE_2D, indirection);
+        for(unsigned int level = 0; level < header.levels; level++)
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, gridSize(level), gridSize(level), GL_RGBA, GL_UNSIGNED_BYTE,
+                            &indirectionData[levelOffsets[level] * 4]);
+        indirectionDirty = false;
+    }
+
+    void createFeedback(int width, int height)
+    {
+        deleteFeedback();
+        feedbackWidth = width;
+        feedbackHeight = height;
+
+        glGenTextures(1, &feedbackColor);
+        GLState::get().bindTexture(GL_TEXTURE_2D, feedbackColor);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenRenderbuffers(1, &feedbackDepth);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+        glGenFramebuffers(1, &feedbackFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColor, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::VIRTUAL_TEXTURE:: feedback framebuffer is not complete" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if(!feedbackPBOs[0])
+            glGenBuffers(FEEDBACK_PBO_COUNT, feedbackPBOs);
+        for(unsigned int i = 0; i < FEEDBACK_PBO_COUNT; i++)
+        {
+            GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBOs[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+            feedbackPixels[i] = 0;
+        }
+        GLState::get().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    void deleteFeedback()
+    {
+        if(feedbackFBO)
+            glDeleteFramebuffers(1, &feedbackFBO);
+        if(feedbackColor)
+            GLState::get().deleteTextures(1, &feedbackColor);
+        if(feedbackDepth)
+            glDeleteRenderbuffers(1, &feedbackDepth);
+        feedbackFBO = feedbackColor = feedbackDepth = 0;
+        feedbackWidth = feedbackHeight = 0;
+    }
+
+    void loadLoop()
+    {
+        for(;;)
+        {
+            unsigned int page;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || !pageRequests.empty(); });
+                if(stopping)
+                    return;
+                page = pageRequests.front();
+                pageRequests.pop_front();
+            }
+            vector<unsigned char> data;
+            readPage(page, data);
+            lock_guard<mutex> lock(queueMutex);
+            loadedPages.push_back(LoadedPage());
+            loadedPages.back().page = page;
+            loadedPages.back().data.swap(data);
+        }
+    }
+
+    void stopWorker()
+    {
+        if(!worker.joinable())
+            return;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        worker.join();
+    }
+
+    // size of a level of an image whose level 0 is 'size' texels, rounding up so pages stay aligned
+    static unsigned int levelExtent(unsigned int size, unsigned int level)
+    {
+        return (size + (1u << level) - 1) >> level;
+    }
+
+    // copies one page with its border out of a level image, clamping at the image edges
+    static void cutPage(const vector<unsigned char> &level, int width, int height, int channels, unsigned int x,
+                        unsigned int y, vector<unsigned char> &page)
+    {
+        int x0 = (int)(x * VT_PAGE_SIZE) - (int)VT_PAGE_BORDER, y0 = (int)(y * VT_PAGE_SIZE) - (int)VT_PAGE_BORDER;
+        for(unsigned int row = 0; row < VT_SLOT_SIZE; row++)
+        {
+            int sy = min(max(y0 + (int)row, 0), height - 1);
+            const unsigned char *src = &level[(size_t)sy * width * channels];
+            unsigned char *dst = &page[(size_t)row * VT_SLOT_SIZE * channels];
+            for(unsigned int column = 0; column < VT_SLOT_SIZE; column++)
+            {
+                int sx = min(max(x0 + (int)column, 0), width - 1);
+                memcpy(dst + column * channels, src + (size_t)sx * channels, channels);
+            }
+        }
+    }
+
+    // 2x2 box filter to the next level, rounding the size up; odd edges reuse their last row/column
+    static void downsample(const vector<unsigned char> &src, int width, int height, int channels, vector<unsigned char> &dst)
+    {
+        int w = (width + 1) / 2, h = (height + 1) / 2;
+        dst.resize((size_t)w * h * channels);
+        for(int y = 0; y < h; y++)
+        {
+            int y0 = y * 2, y1 = min(y0 + 1, height - 1);
+            for(int x = 0; x < w; x++)
+            {
+                int x0 = x * 2, x1 = min(x0 + 1, width - 1);
+                for(int c = 0; c < channels; c++)
+                {
+                    int sum = src[((size_t)y0 * width + x0) * channels + c] + src[((size_t)y0 * width + x1) * channels + c] +
+                              src[((size_t)y1 * width + x0) * channels + c] + src[((size_t)y1 * width + x1) * channels + c];
+                    dst[((size_t)y * w + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+    VirtualTexture(const VirtualTexture&);
+    VirtualTexture& operator=(const VirtualTexture&);
+};
+#endif
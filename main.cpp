@@ -6,8 +6,21 @@
 #include "graphics\Include\glm\gtc\type_ptr.hpp"
 
 #include "graphics\Include\learnopengl\shader_m.h"
+#include "graphics\Include\learnopengl\asteroid_belt.h"
 #include "graphics\Include\learnopengl\camera.h"
+#include "graphics\Include\learnopengl\frustum_culler.h"
+#include "graphics\Include\learnopengl\job_system.h"
 #include "graphics\Include\learnopengl\model.h"
+#include "graphics\Include\learnopengl\model_loader.h"
+#include "graphics\Include\learnopengl\normal_matrix.h"
+#include "graphics\Include\learnopengl\occlusion_queries.h"
+#include "graphics\Include\learnopengl\render_queue.h"
+#include "graphics\Include\learnopengl\scene_graph.h"
+#include "graphics\Include\learnopengl\sim_clock.h"
+#include "graphics\Include\learnopengl\star_system.h"
+#include "graphics\Include\learnopengl\kepler_orbits.h"
+#include "graphics\Include\learnopengl\nbody.h"
+#include "graphics\Include\learnopengl\uniform_buffers.h"
 
 #define WINDOWS
 #ifdef WINDOWS
@@ -18,8 +31,52 @@
 #define GetCurrentDir getcwd
 #endif
 #include <iostream>
+#include <iomanip>
 #include <math.h>
 #include <algorithm> 
+#include <chrono>
+#include <thread>
+
+// build with CHECK_DRAW_ALLOCATIONS defined to count heap allocations made while drawing a frame; after the
+// first frames (which resolve the sampler handles of each material and program) there must be none. Run such a
+// build with --check-allocations to have it draw a fixed number of frames and fail when any of them allocated.
+// Only the GL thread while it draws and the jobs recording the draws count (see DrawAllocationScope), so the
+// texture decoders and other background work may allocate as they like.
+#ifdef CHECK_DRAW_ALLOCATIONS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+std::atomic<unsigned long long> allocationCount(0);
+thread_local bool countAllocations = false;
+void *operator new(size_t size)
+{
+    if (countAllocations)
+        allocationCount++;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+// counts the allocations of this thread while it lives
+struct DrawAllocationScope
+{
+    bool counted;
+    DrawAllocationScope() : counted(countAllocations) { countAllocations = true; }
+    ~DrawAllocationScope() { countAllocations = counted; }
+};
+#else
+struct DrawAllocationScope
+{
+    DrawAllocationScope() {}
+};
+#endif
 
 
 const float PI = 3.1415926535897932384626433832795;
@@ -32,10 +89,30 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
 void RotationStop();
 string GetCurrentWorkingDir(void);
+int BenchmarkDXT(string const &path);
+int BenchmarkAsteroids(GLFWwindow *window, Model &rock, Shader &instancedShader, Shader &shader, UniformBuffer<CameraBlock> &cameraBuffer,
+                       unsigned int maxCount);
+int BenchmarkNormalMatrix(Model **models, const char **names, unsigned int modelCount, Shader &inverseShader, Shader &shader);
+
+// render queue passes, drawn in this order. Bodies that can be hidden behind the sun or the earth come last, after
+// the occlusion queries of their boxes (with --occlusion).
+enum RenderPass { PASS_EMISSIVE, PASS_SUN_LIT, PASS_LIT, PASS_OCCLUDABLE };
 
 // settings
 const unsigned int SCR_WIDTH = 1920;
 const unsigned int SCR_HEIGHT = 1080;
+// how fast the orbits turn and the camera moves, in radians per second (0.01 per frame at 60 fps)
+const float ORBIT_SPEED = 0.6f;
+const float CAMERA_SPEED = 0.6f;
+// --nbody: the sun's mass (G = 1), giving the middle of the belt the turn rate it has without gravity, the rocks'
+// mass together as a fraction of it, and the most simulation steps run per frame: when the rocks take longer than
+// that, they slow down instead of taking the frame rate down with them
+const float NBODY_SUN_MASS = 370.0f;
+const float NBODY_BELT_MASS = 0.01f;
+const unsigned int NBODY_MAX_STEPS_PER_FRAME = 2;
+// --check-allocations: frames drawn by default, and the first frames allowed to allocate while handles resolve
+const unsigned int ALLOCATION_CHECK_FRAMES = 300;
+const unsigned int ALLOCATION_WARMUP_FRAMES = 60;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 0.0f));
@@ -51,14 +128,23 @@ float lastFrame = 0.0f;
 glm::vec3 lightPos(0.0f, 16.0f, -50.0f);
 glm::vec3 spacePos(0.0f, 10.0f, -50.0f);
 
-glm::mat4 earth_matrix = glm::mat4(1.0f);
-
 float a = 0.0, b = PI_2;
 float old_camX = 0.0f, old_camZ = 0.0f, old_camY = 0.0f;
 float camX = 0.0f, camZ = 0.0f, camY = 0.0f;
 
-int main()
+int main(int argc, char *argv[])
 {
+    // benchmark modes: run without opening a window
+    // ---------------------------------------------
+    if (argc > 1 && string(argv[1]) == "--bench-dxt")
+        return BenchmarkDXT(argc > 2 ? argv[2] : GetCurrentWorkingDir() + "/resources/earth/Model/Ocean_Mask.png");
+    if (argc > 1 && string(argv[1]) == "--bench-kepler")
+        return KeplerOrbits::benchmark(cout) ? 0 : 1;
+    if (argc > 1 && string(argv[1]) == "--bench-system")
+        return StarSystem::benchmark(cout) ? 0 : 1;
+    if (argc > 1 && string(argv[1]) == "--bench-nbody")
+        return NBodySimulation::benchmark(cout, argc > 2 && atoi(argv[2]) > 0 ? (unsigned int)atoi(argv[2]) : 200000) ? 0 : 1;
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -106,15 +192,238 @@ int main()
     // load models
     // -----------
 	string current_path = GetCurrentWorkingDir();
-    Model sun(current_path + "/resources/sun/planet.obj");
-    Model earth(current_path + "/resources/earth/Model/Globe.obj");
-    Model moon(current_path + "/resources/rock/rock/rock.obj");
+    // --system [file]: the bodies, their orbits and models (resources/solar_system.txt by default). Their
+    // transforms are nodes of the scene graph.
+    SceneGraph scene;
+    StarSystem starSystem;
+    string systemPath = current_path + "/resources/solar_system.txt";
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (string(argv[i]) == "--system")
+            systemPath = argv[i + 1];
+    }
+    if (!starSystem.load(systemPath, scene))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    // --asteroids [count]: an instanced belt of rocks between the sun and the earth's orbit (100000 by default)
+    // --bench-asteroids [count]: frame time of the belt against its number of rocks (up to 500000), then exit
+    // the rock model is only loaded when one of them is given, and shared with the bodies that use it (the moon)
+    unsigned int beltCount = 0;
+    bool benchAsteroids = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option != "--asteroids" && option != "--bench-asteroids")
+            continue;
+        benchAsteroids = option == "--bench-asteroids";
+        beltCount = i + 1 < argc ? (unsigned int)atoi(argv[i + 1]) : 0;
+        if (beltCount == 0)
+            beltCount = benchAsteroids ? 500000 : 100000;
+    }
+
+    // all models are imported in parallel, only the GL upload runs on this thread. Their textures
+    // show a placeholder until the streamer has decoded and uploaded them in the background, and
+    // are kept DXT compressed (cached as .dds next to each image after the first run). Vertices are
+    // uploaded in the 20 byte PackedVertex layout.
+    TextureStreamer textureStreamer;
+    unsigned int beltModel = StarSystem::NO_MODEL;
+    if (beltCount)
+        beltModel = starSystem.addModel("resources/rock/rock/rock.obj");
+    function<void(Model&)> setupModel = [&](Model &model) {
+        model.textureStreamer = &textureStreamer;
+        model.compressTextures = true;
+        model.packVertices = true;
+    };
+    {
+        ThreadPool pool;
+        ModelLoader loader(pool);
+        starSystem.loadModels(loader, current_path, setupModel);
+        loader.load();
+    }
+    Model *asteroid = beltCount ? starSystem.models[beltModel] : NULL;
 
 	lightingShader.use();
 	lightingShader.setInt("material.diffuse", 0);
 	lightingShader.setInt("material.specular", 1);
 
-	float rotatePos = 0.00000;
+    // camera, light and material live in uniform buffers shared by all programs. The light and material
+    // never change, so only the camera is uploaded per frame; the sun's lit pass just binds a brighter light.
+    UniformBuffer<CameraBlock> cameraBuffer(CAMERA_BLOCK_BINDING);
+    UniformBuffer<LightBlock> lightBuffer(LIGHT_BLOCK_BINDING);
+    UniformBuffer<LightBlock> sunLightBuffer(LIGHT_BLOCK_BINDING);
+    UniformBuffer<MaterialBlock> materialBuffer(MATERIAL_BLOCK_BINDING);
+    LightBlock light = LightBlock();
+    light.position = lightPos;
+    light.ambient = glm::vec3(1.0f, 1.0f, 1.0f);
+    light.diffuse = glm::vec3(100.0f, 100.0f, 100.0f);
+    light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    light.constant = 1.0f;
+    light.linear = 0.09f;
+    light.quadratic = 0.032f;
+    lightBuffer.update(light);
+    light.ambient = glm::vec3(10.0f, 10.0f, 10.0f);
+    light.diffuse = glm::vec3(10.0f, 10.0f, 10.0f);
+    sunLightBuffer.update(light);
+    lightBuffer.bind();
+    MaterialBlock material = MaterialBlock();
+    material.shininess = 32.0f;
+    materialBuffer.update(material);
+
+    // --virtual-texture [image]: the earth's surface comes from a paged virtual texture instead
+    // (Ocean_Mask.png by default), so its source image can be far larger than a GL texture
+    VirtualTexture *virtualTexture = NULL;
+    Shader vtLightingShader("2.2.basic_lighting.vs", "2.2.basic_lighting_vt.fs");
+    Shader vtFeedbackShader("2.2.basic_lighting.vs", "vt_feedback.fs");
+    BindUniformBlocks(ourShader);
+    BindUniformBlocks(lightingShader);
+    BindUniformBlocks(lampShader);
+    BindUniformBlocks(vtLightingShader);
+    BindUniformBlocks(vtFeedbackShader);
+
+    // the belt, see --asteroids above
+    Shader asteroidShader("asteroid.vs", "2.2.basic_lighting.fs");
+    BindUniformBlocks(asteroidShader);
+    asteroidShader.use();
+    asteroidShader.setInt("material.diffuse", 0);
+    asteroidShader.setInt("material.specular", 1);
+    AsteroidBelt belt;
+    if (benchAsteroids)
+    {
+        int result = BenchmarkAsteroids(window, *asteroid, asteroidShader, lightingShader, cameraBuffer, beltCount);
+        glfwTerminate();
+        return result;
+    }
+    if (beltCount)
+    {
+        belt.generate(beltCount, 18.0f, 24.0f, 1.5f, 0.03f, 0.12f);
+        belt.upload();
+        asteroid->setInstanceBuffer(belt.instanceBuffer());
+    }
+    // the per-frame CPU work (simulation, transforms, culling, recording the draws) runs as jobs on every core;
+    // this thread joins in while it waits and then only issues the recorded draws
+    JobSystem jobs;
+
+    // --nbody [theta]: with --asteroids, the rocks orbit the sun and pull on each other under gravity (see
+    // NBodySimulation) instead of turning with the belt; a smaller theta is more accurate and slower (0.7 by default)
+    NBodySimulation *nbody = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) != "--nbody" || nbody || !belt.size())
+            continue;
+        nbody = new NBodySimulation(jobs);
+        if (i + 1 < argc && atof(argv[i + 1]) > 0.0)
+            nbody->theta = (float)atof(argv[i + 1]);
+        nbody->centralMass = NBODY_SUN_MASS;
+        nbody->softening = 0.1f;
+        float rockMass = NBODY_SUN_MASS * NBODY_BELT_MASS / belt.size();
+        for (unsigned int r = 0; r < belt.size(); r++)
+            nbody->addOrbiting(glm::vec3(belt.instances[r].positionScale), rockMass);
+    }
+    // --bench-normal-matrix: vertex stage time of the system's models with the normal matrix inverted per vertex
+    // and uploaded per object, then exit
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) != "--bench-normal-matrix")
+            continue;
+        Shader inverseShader("2.2.basic_lighting_inverse.vs", "2.2.basic_lighting.fs");
+        BindUniformBlocks(inverseShader);
+        vector<const char*> names;
+        for (unsigned int m = 0; m < starSystem.modelPaths.size(); m++)
+            names.push_back(starSystem.modelPaths[m].c_str());
+        int result = BenchmarkNormalMatrix(starSystem.models.data(), names.data(), (unsigned int)names.size(), inverseShader, lightingShader);
+        glfwTerminate();
+        return result;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) != "--virtual-texture")
+            continue;
+        // the image is optional, the next option isn't one
+        string image = current_path + "/resources/earth/Model/Ocean_Mask.png";
+        if (i + 1 < argc && string(argv[i + 1]).compare(0, 2, "--") != 0)
+            image = argv[i + 1];
+        virtualTexture = new VirtualTexture();
+        if (!virtualTexture->load(image))
+        {
+            delete virtualTexture;
+            virtualTexture = NULL;
+        }
+        vtLightingShader.use();
+        vtLightingShader.setInt("material.specular", 1);
+    }
+
+    // --occlusion: occludable bodies and the belt's sectors are tested against the depth of the sun and the earth with
+    // occlusion queries and only drawn when some of their box is visible
+    OcclusionQueries *occlusion = NULL;
+    Shader occlusionBoxShader("occlusion_box.vs", "occlusion_box.fs");
+    BindUniformBlocks(occlusionBoxShader);
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--occlusion" && !occlusion)
+            occlusion = new OcclusionQueries(0.1f);
+    }
+
+    // the frame's draws are recorded by two jobs, the bodies' and the belt's, then sorted together; the lit sun uses
+    // the brighter light, everything else the normal one. Meshes and rocks outside the view are dropped before
+    // they are recorded.
+    RenderQueue renderQueue;
+    FrustumCuller culler;
+    CommandList bodyCommands, beltCommands;
+    CommandList *commandLists[] = { &bodyCommands, &beltCommands };
+    bodyCommands.setCuller(&culler);
+    beltCommands.setCuller(&culler);
+    renderQueue.setPassSetup(PASS_SUN_LIT, [&]() { sunLightBuffer.bind(); });
+    renderQueue.setPassSetup(PASS_LIT, [&]() { lightBuffer.bind(); });
+    renderQueue.setPassSetup(PASS_OCCLUDABLE, [&]() {
+        lightBuffer.bind();
+        if (occlusion)
+            occlusion->issue(occlusionBoxShader);
+    });
+
+    // the belt turns about the system's first body
+    const glm::vec3 Y_AXIS(0.0f, 1.0f, 0.0f);
+    unsigned int beltParent = SceneGraph::NO_PARENT;
+    if (!starSystem.bodies.empty())
+        beltParent = starSystem.bodies[0].orbitNode;
+    unsigned int beltNode = scene.add(beltParent);
+    float sceneAngle = -1.0f; // orbit angle the scene's rotations were last set for
+
+    // --tick-rate [hz]: simulation steps per second (60 by default), independent of the frame rate
+    // --max-fps [fps]: caps the frame rate (uncapped by default); the orbits move at the same speed either way
+    SimClock simClock;
+    double maxFps = 0.0;
+    // --check-allocations [frames]: draws that many frames, then exits with 1 if any frame after the warm-up
+    // allocated (needs a build with CHECK_DRAW_ALLOCATIONS)
+    unsigned int checkFrames = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) != "--check-allocations")
+            continue;
+        checkFrames = i + 1 < argc && atoi(argv[i + 1]) > 0 ? (unsigned int)atoi(argv[i + 1]) : ALLOCATION_CHECK_FRAMES;
+#ifndef CHECK_DRAW_ALLOCATIONS
+        std::cout << "ERROR::CHECK::--check-allocations needs a build with CHECK_DRAW_ALLOCATIONS defined" << std::endl;
+        glfwTerminate();
+        return 1;
+#endif
+    }
+    unsigned int framesDrawn = 0, allocatingFrames = 0;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (string(argv[i]) == "--tick-rate" && atof(argv[i + 1]) > 0.0)
+            simClock.setTickRate(atof(argv[i + 1]));
+        if (string(argv[i]) == "--max-fps")
+            maxFps = atof(argv[i + 1]);
+    }
+    // the simulated orbit angle after the last two ticks; frames draw the angle interpolated between them
+    float orbitAngle = 0.0f, previousOrbitAngle = 0.0f;
+    // whether the last tick ran an n-body step; the rocks are drawn between the last two n-body states like the
+    // orbits, or where they are when it didn't (paused, or over NBODY_MAX_STEPS_PER_FRAME)
+    bool nbodyLastTickStepped = false;
+    double lastFrameTime = glfwGetTime();
+    bool memoryReported = false;
+    float lastTitleUpdate = 0.0f;
     
     // render loop
     // -----------
@@ -125,18 +434,144 @@ int main()
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        double frameTime = glfwGetTime();
+        double frameSeconds = frameTime - lastFrameTime;
+        lastFrameTime = frameTime;
+
+        // simulation, in fixed ticks; the n-body steps start on the jobs as soon as the frame's jobs exist and run
+        // while this thread handles input and streaming
+        unsigned int nbodySteps = 0;
+        for (unsigned int tick = simClock.advance(frameSeconds); tick > 0; tick--)
+        {
+            previousOrbitAngle = orbitAngle;
+            if (!paused)
+                orbitAngle += ORBIT_SPEED * (float)simClock.tickSeconds();
+            nbodyLastTickStepped = nbody && !paused && nbodySteps < NBODY_MAX_STEPS_PER_FRAME;
+            if (nbodyLastTickStepped)
+                nbodySteps++;
+        }
+        float nbodyStep = ORBIT_SPEED * (float)simClock.tickSeconds();
+        JobSystem::Job *simulate = jobs.create([&]() {
+            for (unsigned int step = 0; step < nbodySteps; step++)
+                nbody->step(nbodyStep);
+        });
+        float rotatePos = previousOrbitAngle + (orbitAngle - previousOrbitAngle) * simClock.alpha();
+        float nbodyAlpha = nbodyLastTickStepped ? simClock.alpha() : 1.0f;
+
+        // the rest of the frame's jobs are created now so the rocks can wait for the simulation, and run once the
+        // camera below is set
+        glm::mat4 view, projection;
+        glm::vec3 eye;
+        float viewportHeight;
+
+        // orbits and spins; only the nodes that turn and what hangs below them are recomputed. The hierarchy is
+        // updated parents first, so this is one job; the bodies and the belt wait for it.
+        // Levels of detail follow the size on screen; a model several bodies share (the sun's glow and its lit
+        // surface, the moon and the belt's rocks as seen at the belt's center) gets the level of the one that looks
+        // largest. They are picked here, before the bodies and the belt draw the shared models.
+        JobSystem::Job *transforms = jobs.create([&]() {
+            DrawAllocationScope counting;
+            if (rotatePos != sceneAngle)
+            {
+                starSystem.animate(scene, rotatePos);
+                if (!nbody)
+                    scene.setRotation(beltNode, glm::angleAxis(rotatePos * 0.2f, Y_AXIS));
+                sceneAngle = rotatePos;
+            }
+            scene.update();
+            starSystem.selectLods(scene, view, projection, viewportHeight, beltModel,
+                                  glm::scale(scene.world(beltNode), glm::vec3(0.12f, 0.12f, 0.12f)));
+        });
+
+        JobSystem::Job *bodies = jobs.create([&]() {
+            DrawAllocationScope counting;
+            for (unsigned int i = 0; i < starSystem.bodies.size(); i++)
+            {
+                const Body &body = starSystem.bodies[i];
+                if (body.model == StarSystem::NO_MODEL)
+                    continue;
+                Model &model = *starSystem.models[body.model];
+                const glm::mat4 &matrix = scene.world(body.node);
+                switch (body.shading)
+                {
+                case BODY_EMISSIVE:
+                    bodyCommands.submit(model, lampShader, matrix, view, PASS_EMISSIVE);
+                    break;
+                case BODY_SUN_LIT:
+                    bodyCommands.submit(model, lightingShader, matrix, view, PASS_SUN_LIT);
+                    break;
+                case BODY_LIT:
+                    bodyCommands.submit(model, virtualTexture && body.virtualSurface ? vtLightingShader : lightingShader, matrix, view, PASS_LIT);
+                    break;
+                case BODY_OCCLUDABLE:
+                {
+                    // only bodies in view get a query, a box outside the view would count as hidden
+                    unsigned int query = 0;
+                    if (occlusion && culler.boxVisible(matrix, model.boxMin, model.boxMax))
+                        query = occlusion->add(matrix, model.boxMin, model.boxMax, eye, model.triangleCount());
+                    bodyCommands.submit(model, lightingShader, matrix, view, PASS_OCCLUDABLE, 0, 0, query);
+                    break;
+                }
+                }
+            }
+        });
+        jobs.depend(bodies, transforms);
+
+        // ASTEROIDS, one draw call for the rocks in view; they move once the n-body steps are done
+        JobSystem::Job *rocks = jobs.create([&]() {
+            DrawAllocationScope counting;
+            if (!belt.size())
+                return;
+            // every frame, the rocks move between steps as the orbits do
+            if (nbody)
+                belt.setPositions(nbody->previousX.data(), nbody->previousY.data(), nbody->previousZ.data(),
+                                  nbody->x.data(), nbody->y.data(), nbody->z.data(), nbodyAlpha);
+            const glm::mat4 &belt_matrix = scene.world(beltNode);
+            unsigned int visibleRocks = belt.cull(culler, belt_matrix, asteroid->bounds, jobs);
+            if (occlusion)
+            {
+                // one draw and one query per sector with rocks in view
+                for (unsigned int c = 0; c < AsteroidBelt::CLUSTERS; c++)
+                {
+                    unsigned int count = belt.clusterCount(c);
+                    if (!count)
+                        continue;
+                    glm::vec3 boxMin, boxMax;
+                    belt.clusterBox(c, asteroid->bounds, boxMin, boxMax);
+                    unsigned int query = occlusion->add(belt_matrix, boxMin, boxMax, eye, count * asteroid->triangleCount());
+                    beltCommands.submit(*asteroid, asteroidShader, belt_matrix, view, PASS_OCCLUDABLE, count, belt.clusterFirst(c), query);
+                }
+            }
+            else if (visibleRocks)
+                beltCommands.submit(*asteroid, asteroidShader, belt_matrix, view, PASS_OCCLUDABLE, visibleRocks);
+        });
+        jobs.depend(rocks, transforms);
+        jobs.depend(rocks, simulate);
+        jobs.run(simulate);
 
         // input
         // -----
         processInput(window);
 
+        // finish any textures that were decoded since the last frame
+        textureStreamer.update();
+        if (virtualTexture)
+            virtualTexture->update();
+        // once every texture is in, report what the models keep resident (their CPU arrays were freed after upload)
+        if (!memoryReported && textureStreamer.pending() == 0)
+        {
+            for (unsigned int m = 0; m < starSystem.models.size(); m++)
+                starSystem.models[m]->memoryReport(cout);
+            memoryReported = true;
+        }
+
         // render
         // ------
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         old_camX = camX, old_camZ = camZ, old_camY = camY;
-        glm::mat4 view = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
+        view = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
         const float radius = 70.0f;
         camX = sin(1.0 * a) * sin(1.0 * b) * radius;
         camZ = -50.0 + cos(1.0 * a) * sin(1.0 * b) * radius;
@@ -148,117 +583,154 @@ int main()
 
         view = glm::lookAt(glm::vec3(camX, camY, camZ), cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f));
 
-        // be sure to activate shader when setting uniforms/drawing objects
-        lightingShader.use();
-        lightingShader.setVec3("objectColor", 1.0f, 0.5f, 0.31f);
-        lightingShader.setVec3("light.position", lightPos);
-        lightingShader.setVec3("viewPos", camera.Position);
-		lightingShader.setVec3("light.ambient", 1.0f, 1.0f, 1.0f);
-		lightingShader.setVec3("light.diffuse", 100.0f, 100.0f, 100.0f);
-		lightingShader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-		lightingShader.setFloat("light.constant", 1.0f);
-		lightingShader.setFloat("light.linear", 0.09f);
-		lightingShader.setFloat("light.quadratic", 0.032f);
-		lightingShader.setFloat("material.shininess", 32.0f);
-
         // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-
-
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
-
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        lightingShader.setMat4("model", model);
-
-		//SUN
-		lampShader.use();
-		lampShader.setMat4("projection", projection);
-		lampShader.setMat4("view", view);
-
-        glm::mat4 sun_matrix = glm::mat4(1.0f);
-        sun_matrix = glm::translate(sun_matrix, glm::vec3(0.0f, 0.0f, -50.0f));
-        sun_matrix = glm::scale(sun_matrix, glm::vec3(0.7f, 0.7f, 0.7f));	// it's a bit too big for our scene, so scale it down
-		lampShader.setMat4("model", sun_matrix);
-        
-        sun.Draw(lampShader);
-
-		lightingShader.use();
-
-		lightingShader.setVec3("objectColor", 1.0f, 0.5f, 0.31f);
-		lightingShader.setVec3("light.position", lightPos);
-		lightingShader.setVec3("viewPos", camera.Position);
-
-		lightingShader.setVec3("light.ambient", 10.0f, 10.0f, 10.0f);
-		lightingShader.setVec3("light.diffuse", 10.0f, 10.0f, 10.0f);
-		lightingShader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-
-		lightingShader.setFloat("light.constant", 1.0f);
-		lightingShader.setFloat("light.linear", 0.09f);
-		lightingShader.setFloat("light.quadratic", 0.032f);
-
-		lightingShader.setFloat("material.shininess", 32.0f);
-
-		lightingShader.setMat4("projection", projection);
-		lightingShader.setMat4("view", view);
-
-		sun_matrix = glm::scale(sun_matrix, glm::vec3(1.50f, 1.50f, 1.50f));
-		lightingShader.setMat4("model", sun_matrix);
-
-		sun.Draw(lightingShader);
-
-        //EARTH
-
-		lightingShader.setVec3("objectColor", 1.0f, 0.5f, 0.31f);
-		lightingShader.setVec3("light.position", lightPos);
-		lightingShader.setVec3("viewPos", camera.Position);
-
-		lightingShader.setVec3("light.ambient", 1.0f, 1.0f, 1.0f);
-		lightingShader.setVec3("light.diffuse", 100.0f, 100.0f, 100.0f);
-		lightingShader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-
-		lightingShader.setFloat("light.constant", 1.0f);
-		lightingShader.setFloat("light.linear", 0.09f);
-		lightingShader.setFloat("light.quadratic", 0.032f);
-
-		lightingShader.setFloat("material.shininess", 32.0f);
-
-        earth_matrix = glm::translate(sun_matrix, glm::vec3(30.0f, 0.0f, 0.0f));
-
-		if (!paused) {
-			rotatePos += 0.01;
-		}
-
-		earth_matrix = glm::translate(earth_matrix, glm::vec3(-30.0f, 0.0f, 0.0f));
-		earth_matrix = glm::rotate(earth_matrix, (float)rotatePos, glm::vec3(0.0f, 1.0f, 0.0f));
-		earth_matrix = glm::translate(earth_matrix, glm::vec3(30.0f, 0.0f, 0.0f));
-		earth_matrix = glm::rotate(earth_matrix, (float)rotatePos*3, glm::vec3(0.0f, 1.0f, 0.0f));
-		earth_matrix = glm::scale(earth_matrix, glm::vec3(0.2f, 0.2f, 0.2f));
-
-		lightingShader.setMat4("model", earth_matrix);
-        earth.Draw(lightingShader);
-
-        //MOON
-        glm::mat4 moon_matrix = glm::translate(earth_matrix, glm::vec3(20.0f , 0.0f, 0.0f));
+        projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        // levels of detail are chosen by size in pixels of the framebuffer as it is now, which follows the window
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        viewportHeight = (float)max(framebufferHeight, 1);
+        CameraBlock cameraBlock;
+        cameraBlock.projection = projection;
+        cameraBlock.view = view;
+        cameraBlock.viewPos = glm::vec4(camera.Position, 1.0f);
+        cameraBuffer.update(cameraBlock);
+        culler.setViewProjection(projection * view);
+        eye = glm::vec3(camX, camY, camZ);
+        if (occlusion)
+        {
+            // a query for each body and belt sector that could ask for one, generated here on the GL thread
+            occlusion->beginFrame();
+            occlusion->reserve((unsigned int)starSystem.bodies.size() + AsteroidBelt::CLUSTERS);
+        }
+        // with a virtual texture the diffuse color of 'virtual' bodies is sampled from it, same lighting otherwise
+        if (virtualTexture)
+        {
+            vtLightingShader.use();
+            virtualTexture->bind(vtLightingShader);
+        }
+#ifdef CHECK_DRAW_ALLOCATIONS
+        unsigned long long drawAllocations = allocationCount;
+        countAllocations = true;
+#endif
 
-		moon_matrix = glm::translate(moon_matrix, glm::vec3(-20.0f, 0.0f, 0.0f));
-		moon_matrix = glm::rotate(moon_matrix, (float)(rotatePos * 4), glm::vec3(0.0f, 1.0f, 0.0f));
-		moon_matrix = glm::translate(moon_matrix, glm::vec3(20.0f, 0.0f, 0.0f));
 
+        jobs.run(transforms);
+        jobs.run(bodies);
+        jobs.run(rocks);
+        jobs.wait(bodies);
+        jobs.wait(rocks);
+        if (belt.size())
+            belt.uploadVisible();
+
+        // draws grouped by pass, program and textures, front to back within a group
+        renderQueue.execute(commandLists, 2);
+
+        // virtual texture feedback: which pages the 'virtual' bodies need at their distance
+        if (virtualTexture)
+        {
+            virtualTexture->beginFeedback(vtFeedbackShader, framebufferWidth, framebufferHeight);
+            for (unsigned int i = 0; i < starSystem.bodies.size(); i++)
+            {
+                const Body &body = starSystem.bodies[i];
+                if (!body.virtualSurface || body.model == StarSystem::NO_MODEL)
+                    continue;
+                const glm::mat4 &matrix = scene.world(body.node);
+                vtFeedbackShader.setMat4("model", matrix);
+                vtFeedbackShader.setMat3("normalMatrix", NormalMatrix(matrix));
+                starSystem.models[body.model]->Draw(vtFeedbackShader);
+            }
+            virtualTexture->endFeedback();
+        }
+#ifdef CHECK_DRAW_ALLOCATIONS
+        countAllocations = false;
+        drawAllocations = allocationCount - drawAllocations;
+        if (drawAllocations && framesDrawn >= ALLOCATION_WARMUP_FRAMES)
+        {
+            std::cout << "ERROR::DRAW::" << drawAllocations << " heap allocations while drawing a frame" << std::endl;
+            allocatingFrames++;
+        }
+#endif
 
-		lightingShader.setMat4("model", moon_matrix);
-        moon.Draw(lightingShader);
+        // uniform traffic of this frame (the per object values; camera, light and material are in uniform
+        // buffers), the binds GLState issued and skipped, and what culling kept. Shown in the title once a second;
+        // occlusion results come back a couple of frames late.
+        unsigned int uniformUploads = 0, skippedUploads = 0;
+        Shader *shaders[] = { &ourShader, &lightingShader, &lampShader, &vtLightingShader, &vtFeedbackShader, &asteroidShader,
+                             &occlusionBoxShader };
+        for (unsigned int i = 0; i < sizeof(shaders) / sizeof(shaders[0]); i++)
+        {
+            uniformUploads += shaders[i]->uniformUploads();
+            skippedUploads += shaders[i]->skippedUploads();
+            shaders[i]->resetCounters();
+        }
+        if (currentFrame - lastTitleUpdate >= 1.0f)
+        {
+            ostringstream title;
+            title << "Solar System - uniforms per frame: " << uniformUploads << " uploaded, " << skippedUploads << " skipped"
+                  << ", binds: " << GLState::get().issued() << " issued, " << GLState::get().elided() << " skipped"
+                  << ", meshes: " << culler.visibleObjects << " visible, " << culler.culledObjects << " culled"
+                  << ", rocks: " << culler.visibleInstances << " visible, " << culler.culledInstances << " culled";
+            if (occlusion)
+            {
+                const OcclusionQueries::Stats &stats = occlusion->lastStats();
+                title << ", occlusion: " << stats.occluded << " of " << stats.tested << " hidden, " << stats.triangles << " triangles skipped";
+            }
+            if (nbody)
+            {
+                const NBodySimulation::Timings &timings = nbody->lastTimings();
+                title << ", n-body step: " << fixed << setprecision(1) << timings.build << " ms tree, " << timings.forces << " ms forces";
+            }
+            glfwSetWindowTitle(window, title.str().c_str());
+            lastTitleUpdate = currentFrame;
+        }
+        GLState::get().resetCounters();
+        culler.resetCounters();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        framesDrawn++;
+        if (checkFrames && framesDrawn >= checkFrames)
+            glfwSetWindowShouldClose(window, true);
+
+        // frame rate cap: sleep away what is left of the frame
+        if (maxFps > 0.0)
+        {
+            double remaining = frameTime + 1.0 / maxFps - glfwGetTime();
+            if (remaining > 0.0)
+                std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+        }
+    }
+
+    textureStreamer.release();
+    belt.release();
+    cameraBuffer.release();
+    lightBuffer.release();
+    sunLightBuffer.release();
+    materialBuffer.release();
+    if (virtualTexture)
+    {
+        virtualTexture->release();
+        delete virtualTexture;
+    }
+    if (occlusion)
+    {
+        occlusion->release();
+        delete occlusion;
     }
+    delete nbody;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
+    if (checkFrames)
+    {
+        std::cout << "allocation check: " << allocatingFrames << " of " << framesDrawn - min(framesDrawn, ALLOCATION_WARMUP_FRAMES)
+                  << " frames after the warm-up allocated, " << (allocatingFrames ? "FAILED" : "OK") << std::endl;
+        return allocatingFrames ? 1 : 0;
+    }
     return 0;
 }
 
@@ -270,16 +742,16 @@ void processInput(GLFWwindow* window)
         glfwSetWindowShouldClose(window, true);
    
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        b -= 0.01;
+        b -= CAMERA_SPEED * deltaTime;
     }
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        b += 0.01;
+        b += CAMERA_SPEED * deltaTime;
     }
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-        a -= 0.01;
+        a -= CAMERA_SPEED * deltaTime;
     }
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-        a += 0.01;
+        a += CAMERA_SPEED * deltaTime;
     }
 
 	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
@@ -335,4 +807,173 @@ std::string GetCurrentWorkingDir(void) {
 	GetCurrentDir(buff, FILENAME_MAX);
 	std::string current_working_dir(buff);
 	return current_working_dir;
-}
\ No newline at end of file
+}
+
+// compares DXTEncoder against image_DXT on one image (--bench-dxt [image])
+int BenchmarkDXT(string const &path)
+{
+	int width, height, nrComponents;
+	unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
+	if (!pixels)
+	{
+		std::cout << "ERROR::BENCHMARK:: could not load " << path << std::endl;
+		return -1;
+	}
+	bool ok = DXTEncoder::benchmark(pixels, width, height, nrComponents, convert_image_to_DXT1, std::cout);
+	stbi_image_free(pixels);
+	return ok ? 0 : 1;
+}
+
+// draws an asteroid belt of a growing number of rocks, instanced and (for the smaller counts) with one draw
+// call per rock, and prints the frame times (--bench-asteroids [count])
+int BenchmarkAsteroids(GLFWwindow *window, Model &rock, Shader &instancedShader, Shader &shader, UniformBuffer<CameraBlock> &cameraBuffer,
+                       unsigned int maxCount)
+{
+    const unsigned int WARMUP_FRAMES = 10, FRAMES = 100, MAX_SEPARATE_DRAWS = 10000;
+    const unsigned int COUNTS[] = { 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000 };
+    AsteroidBelt belt;
+    belt.generate(maxCount, 18.0f, 24.0f, 1.5f, 0.03f, 0.12f);
+    belt.upload();
+    rock.setInstanceBuffer(belt.instanceBuffer());
+
+    // the whole belt in view, from above its outer edge
+    CameraBlock cameraBlock;
+    cameraBlock.projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    cameraBlock.view = glm::lookAt(glm::vec3(0.0f, 30.0f, 40.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    cameraBlock.viewPos = glm::vec4(0.0f, 30.0f, 40.0f, 1.0f);
+    cameraBuffer.update(cameraBlock);
+    glfwSwapInterval(0);
+
+    cout << "rock: " << rock.triangleCount() << " triangles" << endl;
+    cout << "   rocks   instanced ms/frame   Mtriangles/s   separate draws ms/frame" << endl;
+    for (unsigned int c = 0; c < sizeof(COUNTS) / sizeof(COUNTS[0]); c++)
+    {
+        unsigned int count = min(COUNTS[c], maxCount);
+        double times[2] = { 0.0, 0.0 };
+        for (int separate = 0; separate < 2; separate++)
+        {
+            if (separate && count > MAX_SEPARATE_DRAWS)
+                break;
+            Shader &program = separate ? shader : instancedShader;
+            for (unsigned int frame = 0; frame < WARMUP_FRAMES + FRAMES; frame++)
+            {
+                if (frame == WARMUP_FRAMES)
+                {
+                    glFinish();
+                    times[separate] = glfwGetTime();
+                }
+                glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                program.use();
+                if (separate)
+                {
+                    for (unsigned int i = 0; i < count; i++)
+                    {
+                        glm::mat4 model = belt.instanceMatrix(i);
+                        program.setMat4("model", model);
+                        program.setMat3("normalMatrix", NormalMatrix(model));
+                        rock.Draw(program);
+                    }
+                }
+                else
+                {
+                    program.setMat4("model", glm::mat4(1.0f));
+                    program.setMat3("normalMatrix", glm::mat3(1.0f));
+                    rock.DrawInstanced(program, count);
+                }
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
+            glFinish();
+            times[separate] = (glfwGetTime() - times[separate]) * 1000.0 / FRAMES;
+        }
+        cout << fixed << setw(8) << count << setprecision(3) << setw(21) << times[0]
+             << setprecision(1) << setw(15) << (double)count * rock.triangleCount() / (times[0] * 1000.0);
+        if (times[1] > 0.0)
+            cout << setprecision(3) << setw(26) << times[1];
+        cout << endl;
+        if (count >= maxCount)
+            break;
+    }
+    belt.release();
+    return 0;
+}
+
+// GPU time of the vertex stage (rasterizer discard, so no fragments) drawing each model at its finest level of
+// detail with the normal matrix inverted per vertex and uploaded per object, and the CPU cost of NormalMatrix()
+// against glm's inverse (--bench-normal-matrix)
+int BenchmarkNormalMatrix(Model **models, const char **names, unsigned int modelCount, Shader &inverseShader, Shader &shader)
+{
+    const unsigned int DRAWS = 200, REPEATS = 10, CPU_MATRICES = 1000000;
+    unsigned int query;
+    glGenQueries(1, &query);
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    cout << "   model   triangles   per vertex inverse ms   per object uniform ms   speedup" << endl;
+    for (unsigned int m = 0; m < modelCount; m++)
+    {
+        Model &model = *models[m];
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+            model.meshes[i].selectLod(1e30f);
+        double times[2];
+        for (int perObject = 0; perObject < 2; perObject++)
+        {
+            Shader &program = perObject ? shader : inverseShader;
+            program.use();
+            times[perObject] = 1e30;
+            for (unsigned int repeat = 0; repeat < REPEATS; repeat++)
+            {
+                glBeginQuery(GL_TIME_ELAPSED, query);
+                for (unsigned int draw = 0; draw < DRAWS; draw++)
+                {
+                    // a different, non-uniformly scaled matrix per draw, as for the bodies of a scene
+                    glm::mat4 matrix = glm::rotate(glm::mat4(1.0f), draw * 0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+                    matrix = glm::scale(matrix, glm::vec3(1.0f, 1.0f + draw * 0.001f, 1.0f));
+                    program.setMat4("model", matrix);
+                    if (perObject)
+                        program.setMat3("normalMatrix", NormalMatrix(matrix));
+                    model.Draw(program);
+                }
+                glEndQuery(GL_TIME_ELAPSED);
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+                times[perObject] = min(times[perObject], nanoseconds / 1e6);
+            }
+        }
+        cout << fixed << setw(8) << names[m] << setw(12) << model.triangleCount() << setprecision(3) << setw(24) << times[0]
+             << setw(24) << times[1] << setprecision(2) << setw(10) << times[0] / max(times[1], 1e-9) << endl;
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+    glDeleteQueries(1, &query);
+
+    // CPU: the SSE cofactor path against transpose(inverse(mat3)), on the same matrices
+    vector<glm::mat4> matrices(1024);
+    for (unsigned int i = 0; i < matrices.size(); i++)
+    {
+        matrices[i] = glm::rotate(glm::mat4(1.0f), i * 0.37f, glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f + i)));
+        matrices[i] = glm::scale(matrices[i], glm::vec3(0.5f + i * 0.001f, 1.0f, 2.0f));
+    }
+    glm::mat3 checksum(0.0f);
+    float maxError = 0.0f;
+    double cpu[2];
+    for (int simd = 0; simd < 2; simd++)
+    {
+        double start = glfwGetTime();
+        for (unsigned int i = 0; i < CPU_MATRICES; i++)
+        {
+            const glm::mat4 &matrix = matrices[i & 1023];
+            checksum += simd ? NormalMatrix(matrix) : glm::transpose(glm::inverse(glm::mat3(matrix)));
+        }
+        cpu[simd] = (glfwGetTime() - start) * 1e9 / CPU_MATRICES;
+    }
+    for (unsigned int i = 0; i < matrices.size(); i++)
+    {
+        glm::mat3 reference = glm::transpose(glm::inverse(glm::mat3(matrices[i]))), simd = NormalMatrix(matrices[i]);
+        for (int c = 0; c < 3; c++)
+            for (int r = 0; r < 3; r++)
+                maxError = max(maxError, fabs(reference[c][r] - simd[c][r]));
+    }
+    cout << "CPU normal matrix: glm inverse " << setprecision(1) << cpu[0] << " ns, NormalMatrix " << cpu[1] << " ns, max difference "
+         << scientific << maxError << defaultfloat << " (checksum " << checksum[0][0] << ")" << endl;
+    return maxError < 1e-4f ? 0 : 1;
+}
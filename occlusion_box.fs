@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+// only counted by an occlusion query, color writes are off
+void main()
+{
+    FragColor = vec4(1.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// shared by all programs, see uniform_buffers.h
+layout (std140) uniform CameraBlock {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+} camera;
+
+uniform mat4 model; // maps the unit cube onto the tested box (see OcclusionQueries)
+
+void main()
+{
+    gl_Position = camera.projection * camera.view * model * vec4(aPos, 1.0);
+}
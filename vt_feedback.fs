@@ -0,0 +1,36 @@
+#version 330 core
+out vec4 FragColor;
+
+// virtual texture, see virtual_texture.h
+struct VirtualTexture {
+    sampler2D atlas;
+    sampler2D indirection;
+    vec2 scale;         // image size / virtual texture size
+    float virtualSize;  // texels along one side of level 0
+    float maxLevel;
+    float pageSize;
+    float border;
+    float atlasSize;
+    float lodBias;
+};
+
+uniform VirtualTexture vt;
+
+float vtLevel(vec2 uv)
+{
+    vec2 dx = dFdx(uv * vt.virtualSize);
+    vec2 dy = dFdy(uv * vt.virtualSize);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vt.lodBias;
+    return clamp(floor(lod), 0.0, vt.maxLevel);
+}
+
+in vec2 TexCoords;
+
+// writes the page every pixel needs: x and y (low 8 bits in r and g, high 4 bits in b), level + 1 in a
+void main()
+{
+    float level = vtLevel(TexCoords * vt.scale);
+    vec2 page = floor(fract(TexCoords) * vt.scale * exp2(vt.maxLevel - level));
+    vec2 high = floor(page / 256.0);
+    FragColor = vec4(page - high * 256.0, high.x + high.y * 16.0, level + 1.0) / 255.0;
+}